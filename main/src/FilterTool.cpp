@@ -7,8 +7,13 @@
 
 #include <FilterTool.h>
 #include <MRIData.h>
+#include <GIRLogger.h>
+#include <ThreadPool.h>
 #include <math.h>
 #include <fftw3.h>
+#include <cstring>
+#include <vector>
+#include <algorithm>
 
 /*
 #ifdef USE_CUDA
@@ -17,79 +22,295 @@
 */
 
 #include <pthread.h>
-#define FFTW_LOCK(a) pthread_mutex_lock( &Mutex ); a; pthread_mutex_unlock( &Mutex );
+#define FFTW_LOCK(a) pthread_mutex_lock( &FilterTool::Mutex ); a; pthread_mutex_unlock( &FilterTool::Mutex );
 
 pthread_mutex_t FilterTool::Mutex;
 
-void FilterTool::Conv2D( MRIData& image_volume, float* kernel, int kernel_rows, int kernel_cols ) {
-	int cols = image_volume.Size().Column;
-	int lines = image_volume.Size().Line;
-	int channels = image_volume.Size().Channel;
-	int sets = image_volume.Size().Set;
-	int phases = image_volume.Size().Phase;
-	int slices = image_volume.Size().Slice;
-	int echos = image_volume.Size().Echo;
-	int repetitions = image_volume.Size().Repetition;
-	int partitions = image_volume.Size().Partition;
-	int segments = image_volume.Size().Segment;
-	int averages = image_volume.Size().Average;
-	
-	int im_size = ( image_volume.IsComplex() )? cols*lines*2 : cols*lines;
-	//!possible memory leak
-	float* im_buffer = new float[im_size];
+// non-separable kernels with at least this many taps are applied in the frequency domain
+#define CONV_FFT_MIN_TAPS 64
+// relative tolerance used when deciding whether a kernel is separable
+#define CONV_SEPARABLE_TOLERANCE 1e-4f
 
-	for( int channel = 0; channel < channels; channel++ )
-	for( int set = 0; set < sets; set++ )
-	for( int phase = 0; phase < phases; phase++ )
-	for( int slice = 0; slice < slices; slice++ )
-	for( int echo = 0; echo < echos; echo++ )
-	for( int repetition = 0; repetition < repetitions; repetition++ )
-	for( int partition = 0; partition < partitions; partition++ )
-	for( int segment = 0; segment < segments; segment++ )
-	for( int average = 0; average < averages; average++ )
+// kernel prepared for convolution of row-major (column fastest) images:
+//   out[y][x] = sum( taps[ky][kx] * in[y+origin_y-ky][x+origin_x-kx] )
+// with out of bounds indices clamped to the image edge
+class ConvKernel
+{
+	public:
+	enum ConvMode { CONV_DIRECT, CONV_SEPARABLE, CONV_FFT };
+
+	ConvKernel(): spectrum( 0 ), forward_plan( 0 ), inverse_plan( 0 ) {}
+	~ConvKernel();
+
+	ConvMode mode;
+	int width;
+	int height;
+	int origin_x;
+	int origin_y;
+	std::vector<float> taps;
+	std::vector<float> taps_x;
+	std::vector<float> taps_y;
+
+	// only used for CONV_FFT
+	int fft_cols;
+	int fft_lines;
+	fftwf_complex* spectrum;
+	fftwf_plan forward_plan;
+	fftwf_plan inverse_plan;
+};
+
+class ConvArgs
+{
+	public:
+	ConvKernel* kernel;
+	float* images;
+	int cols;
+	int lines;
+	bool is_complex;
+	int first_image;
+	int last_image;
+};
+
+ConvKernel::~ConvKernel()
+{
+	if( forward_plan != 0 ) { FFTW_LOCK( fftwf_destroy_plan( forward_plan ); ) }
+	if( inverse_plan != 0 ) { FFTW_LOCK( fftwf_destroy_plan( inverse_plan ); ) }
+	if( spectrum != 0 ) { FFTW_LOCK( fftwf_free( spectrum ); ) }
+}
+
+static inline int ClampIndex( int index, int size )
+{
+	if( index < 0 )
+		return 0;
+	if( index >= size )
+		return size - 1;
+	return index;
+}
+
+// try to factor taps into taps_y (outer) x taps_x (inner)
+static bool SplitKernel( const std::vector<float>& taps, int width, int height, std::vector<float>& taps_x, std::vector<float>& taps_y )
+{
+	int pivot = 0;
+	for( int i = 1; i < width * height; i++ )
+		if( fabs( taps[i] ) > fabs( taps[pivot] ) )
+			pivot = i;
+
+	float pivot_value = taps[pivot];
+	if( pivot_value == 0 )
+		return false;
+	int pivot_x = pivot % width;
+	int pivot_y = pivot / width;
+
+	taps_x.resize( width );
+	taps_y.resize( height );
+	for( int x = 0; x < width; x++ )
+		taps_x[x] = taps[pivot_y*width + x] / pivot_value;
+	for( int y = 0; y < height; y++ )
+		taps_y[y] = taps[y*width + pivot_x];
+
+	float tolerance = CONV_SEPARABLE_TOLERANCE * fabs( pivot_value );
+	for( int y = 0; y < height; y++ )
+	for( int x = 0; x < width; x++ )
+		if( fabs( taps[y*width + x] - taps_y[y]*taps_x[x] ) > tolerance )
+			return false;
+
+	return true;
+}
+
+// convolve each line with taps, src and dest must not overlap
+static void ConvRows( const float* src, float* dest, int cols, int lines, int comps, const float* taps, int num_taps, int origin, float* row_buffer )
+{
+	int row_size = cols * comps;
+	int first_col = origin - ( num_taps - 1 );
+	int padded_cols = cols + num_taps - 1;
+
+	for( int line = 0; line < lines; line++ )
 	{
-		float* slice_address = image_volume.GetDataIndex( 0, 0, channel, set, phase, slice, echo, repetition, partition, segment, average );
+		const float* src_row = src + line*row_size;
+		float* dest_row = dest + line*row_size;
 
-		// stupidly Conv2D works on data stored in a different -major order than MRIData is stored
-		int column, line;
-		int volume_index, buffer_index;
+		// extend the row at its edges so the tap loop doesn't need to check bounds
+		for( int i = 0; i < padded_cols; i++ )
+		{
+			int col = ClampIndex( i + first_col, cols );
+			for( int c = 0; c < comps; c++ )
+				row_buffer[i*comps + c] = src_row[col*comps + c];
+		}
 
-		// copy MRIData to buffer
-		for( column = 0; column < cols; column++ )
-		for( line = 0; line < lines; line++ )
+		for( int i = 0; i < row_size; i++ )
+			dest_row[i] = 0;
+
+		for( int k = 0; k < num_taps; k++ )
 		{
-			buffer_index = column*lines + line;
-			volume_index = line*cols + column;
+			float tap = taps[k];
+			if( tap == 0 )
+				continue;
+			const float* shifted = row_buffer + ( num_taps - 1 - k ) * comps;
+			for( int i = 0; i < row_size; i++ )
+				dest_row[i] += tap * shifted[i];
+		}
+	}
+}
 
-			if( image_volume.IsComplex() )
-			{
-				im_buffer[2*buffer_index] = slice_address[2*volume_index];
-				im_buffer[2*buffer_index+1] = slice_address[2*volume_index+1];
-			}
-			else
-				im_buffer[buffer_index] = slice_address[volume_index];
+// convolve each column with taps, src and dest must not overlap
+static void ConvLines( const float* src, float* dest, int cols, int lines, int comps, const float* taps, int num_taps, int origin )
+{
+	int row_size = cols * comps;
+	for( int line = 0; line < lines; line++ )
+	{
+		float* dest_row = dest + line*row_size;
+		for( int i = 0; i < row_size; i++ )
+			dest_row[i] = 0;
+
+		for( int k = 0; k < num_taps; k++ )
+		{
+			float tap = taps[k];
+			if( tap == 0 )
+				continue;
+			const float* src_row = src + ClampIndex( line + origin - k, lines ) * row_size;
+			for( int i = 0; i < row_size; i++ )
+				dest_row[i] += tap * src_row[i];
 		}
+	}
+}
 
-		Conv2D( im_buffer, kernel, im_buffer, lines, cols, kernel_rows, kernel_cols, image_volume.IsComplex(), false );
+// full 2D convolution in the spatial domain, src and dest must not overlap
+static void ConvDirect( const float* src, float* dest, int cols, int lines, int comps, const ConvKernel& kernel, float* row_buffer )
+{
+	int row_size = cols * comps;
+	int first_col = kernel.origin_x - ( kernel.width - 1 );
+	int padded_cols = cols + kernel.width - 1;
 
-		// copy buffer to MRIData
-		for( column = 0; column < cols; column++ )
-		for( line = 0; line < lines; line++ )
+	for( int i = 0; i < row_size * lines; i++ )
+		dest[i] = 0;
+
+	for( int line = 0; line < lines; line++ )
+	for( int ky = 0; ky < kernel.height; ky++ )
+	{
+		const float* src_row = src + ClampIndex( line + kernel.origin_y - ky, lines ) * row_size;
+		float* dest_row = dest + line*row_size;
+
+		for( int i = 0; i < padded_cols; i++ )
 		{
-			buffer_index = column*lines + line;
-			volume_index = line*cols + column;
+			int col = ClampIndex( i + first_col, cols );
+			for( int c = 0; c < comps; c++ )
+				row_buffer[i*comps + c] = src_row[col*comps + c];
+		}
 
-			if( image_volume.IsComplex() )
-			{
-				slice_address[2*volume_index] = im_buffer[2*buffer_index];
-				slice_address[2*volume_index+1] = im_buffer[2*buffer_index+1];
-			}
-			else
-				slice_address[volume_index] = im_buffer[buffer_index];
+		for( int kx = 0; kx < kernel.width; kx++ )
+		{
+			float tap = kernel.taps[ky*kernel.width + kx];
+			if( tap == 0 )
+				continue;
+			const float* shifted = row_buffer + ( kernel.width - 1 - kx ) * comps;
+			for( int i = 0; i < row_size; i++ )
+				dest_row[i] += tap * shifted[i];
+		}
+	}
+}
+
+// circular convolution on a grid padded by the kernel size, so the wrap around never reaches the image
+static void ConvFFT( float* image, int cols, int lines, int comps, const ConvKernel& kernel, fftwf_complex* buffer )
+{
+	int first_col = kernel.origin_x - ( kernel.width - 1 );
+	int first_line = kernel.origin_y - ( kernel.height - 1 );
+	int fft_cols = kernel.fft_cols;
+	int fft_size = kernel.fft_cols * kernel.fft_lines;
+
+	for( int y = 0; y < kernel.fft_lines; y++ )
+	{
+		const float* src_row = image + ClampIndex( y + first_line, lines ) * cols * comps;
+		for( int x = 0; x < fft_cols; x++ )
+		{
+			int col = ClampIndex( x + first_col, cols );
+			buffer[y*fft_cols + x][0] = src_row[col*comps];
+			buffer[y*fft_cols + x][1] = ( comps == 2 )? src_row[col*comps + 1]: 0;
+		}
+	}
+
+	fftwf_execute_dft( kernel.forward_plan, buffer, buffer );
+	for( int i = 0; i < fft_size; i++ )
+	{
+		float real = buffer[i][0] * kernel.spectrum[i][0] - buffer[i][1] * kernel.spectrum[i][1];
+		float imag = buffer[i][0] * kernel.spectrum[i][1] + buffer[i][1] * kernel.spectrum[i][0];
+		buffer[i][0] = real;
+		buffer[i][1] = imag;
+	}
+	fftwf_execute_dft( kernel.inverse_plan, buffer, buffer );
+
+	for( int y = 0; y < lines; y++ )
+	{
+		float* dest_row = image + y*cols*comps;
+		fftwf_complex* src_row = buffer + ( y + kernel.height - 1 ) * fft_cols + kernel.width - 1;
+		for( int x = 0; x < cols; x++ )
+		{
+			dest_row[x*comps] = src_row[x][0];
+			if( comps == 2 )
+				dest_row[x*comps + 1] = src_row[x][1];
+		}
+	}
+}
+
+// worker for FilterTool::Conv2DImages, convolves images [first_image, last_image) in place
+static void* ConvImages( void* args_ptr )
+{
+	ConvArgs* args = (ConvArgs*) args_ptr;
+	ConvKernel& kernel = *args->kernel;
+	int comps = ( args->is_complex )? 2: 1;
+	int image_size = args->cols * args->lines * comps;
+
+	float* scratch = 0;
+	float* row_buffer = 0;
+	fftwf_complex* fft_buffer = 0;
+	if( kernel.mode == ConvKernel::CONV_FFT )
+	{
+		FFTW_LOCK( fft_buffer = (fftwf_complex*) fftwf_malloc( sizeof( fftwf_complex ) * kernel.fft_cols * kernel.fft_lines ); )
+	}
+	else
+	{
+		scratch = new float[image_size];
+		row_buffer = new float[( args->cols + std::max( kernel.width, 1 ) ) * comps];
+	}
+
+	for( int i = args->first_image; i < args->last_image; i++ )
+	{
+		float* image = args->images + (long)i * image_size;
+		switch( kernel.mode )
+		{
+			case ConvKernel::CONV_SEPARABLE:
+				ConvRows( image, scratch, args->cols, args->lines, comps, &kernel.taps_x[0], kernel.width, kernel.origin_x, row_buffer );
+				ConvLines( scratch, image, args->cols, args->lines, comps, &kernel.taps_y[0], kernel.height, kernel.origin_y );
+				break;
+			case ConvKernel::CONV_FFT:
+				ConvFFT( image, args->cols, args->lines, comps, kernel, fft_buffer );
+				break;
+			default:
+				memcpy( scratch, image, image_size * sizeof( float ) );
+				ConvDirect( scratch, image, args->cols, args->lines, comps, kernel, row_buffer );
+				break;
 		}
 	}
 
-	delete [] im_buffer;
+	if( fft_buffer != 0 ) { FFTW_LOCK( fftwf_free( fft_buffer ); ) }
+	delete [] scratch;
+	delete [] row_buffer;
+	return 0;
+}
+
+void FilterTool::Conv2D( MRIData& image_volume, float* kernel, int kernel_rows, int kernel_cols ) {
+	int cols = image_volume.Size().Column;
+	int lines = image_volume.Size().Line;
+	int num_images = image_volume.NumPixels() / ( cols * lines );
+
+	// kernel is stored column-major with rows running along MRIData lines
+	std::vector<float> taps( kernel_rows * kernel_cols );
+	for( int row = 0; row < kernel_rows; row++ )
+	for( int col = 0; col < kernel_cols; col++ )
+		taps[row*kernel_cols + col] = kernel[col*kernel_rows + row];
+
+	// the origin has always been taken from kernel_rows for both directions, callers compensate for it
+	int origin = (int)ceil( kernel_rows / 2.0 ) - 1;
+	Conv2DImages( image_volume.GetDataStart(), num_images, cols, lines, image_volume.IsComplex(), &taps[0], kernel_cols, kernel_rows, origin, origin );
 }
 
 void FilterTool::Conv2D( float *image, float *kernel, float *dest, int image_rows, int image_cols, int kernel_rows, int kernel_cols, bool image_is_complex, bool kernel_is_complex ) {
@@ -97,173 +318,205 @@ void FilterTool::Conv2D( float *image, float *kernel, float *dest, int image_row
 	if( kernel_is_complex )
 		throw "FilterTool::Conv2D -> Convolution with a complex kernel is not yet implemented!";
 
-	int row_pad = (int)ceil( kernel_rows / 2.0 );
-	int col_pad = (int)ceil( kernel_cols / 2.0 );
-	int padded_rows = (image_rows + 2*row_pad);
-	int padded_cols = (image_cols + 2*col_pad);
-	int padded_size = padded_cols * padded_rows;
+	// image and kernel are column-major, which is row-major with rows running along x
+	int image_size = ( image_is_complex )? 2 * image_rows * image_cols: image_rows * image_cols;
+	if( dest != image )
+		memcpy( dest, image, image_size * sizeof( float ) );
+
+	int origin = (int)ceil( kernel_rows / 2.0 ) - 1;
+	Conv2DImages( dest, 1, image_rows, image_cols, image_is_complex, kernel, kernel_rows, kernel_cols, origin, origin );
+}
+
+void FilterTool::Conv2DImages( float* images, int num_images, int cols, int lines, bool is_complex, const float* taps, int kernel_width, int kernel_height, int origin_x, int origin_y )
+{
+	if( num_images < 1 || cols < 1 || lines < 1 || kernel_width < 1 || kernel_height < 1 )
+		return;
 
-	// create source
-	float* source;
-	if( image_is_complex )
-		source = new float[2*padded_size];
+	// pick the cheapest way to apply the kernel
+	ConvKernel kernel;
+	kernel.width = kernel_width;
+	kernel.height = kernel_height;
+	kernel.origin_x = origin_x;
+	kernel.origin_y = origin_y;
+	kernel.taps.assign( taps, taps + kernel_width * kernel_height );
+
+	if( SplitKernel( kernel.taps, kernel_width, kernel_height, kernel.taps_x, kernel.taps_y ) )
+		kernel.mode = ConvKernel::CONV_SEPARABLE;
+	else if( kernel_width * kernel_height >= CONV_FFT_MIN_TAPS )
+		kernel.mode = ConvKernel::CONV_FFT;
 	else
-		source = new float[padded_size];
+		kernel.mode = ConvKernel::CONV_DIRECT;
 
-	// copy image to source and put in padding
-	int source_col;
-	for( source_col = 0; source_col  < padded_cols; source_col++ )
+	// transform the kernel once for all images
+	if( kernel.mode == ConvKernel::CONV_FFT )
 	{
-		int image_col = source_col- col_pad;
-		for( int source_row = 0; source_row < padded_rows; source_row++ )
-		{
-			int image_row = source_row - row_pad;
-
-			if( image_row < 0 )
-				image_row = 0;
-			if( image_row >= image_rows )
-				image_row = image_rows - 1;
-			if( image_col < 0 )
-				image_col = 0;
-			if( image_col >= image_cols )
-				image_col = image_cols - 1;
-
-			// set value of source
-			if( image_is_complex )
-			{
-				source[2*(source_col*padded_rows + source_row)] = image[2*(image_col*image_rows + image_row)];
-				source[2*(source_col*padded_rows + source_row) + 1] = image[2*(image_col*image_rows + image_row) + 1];
-			}
-			else
-				source[source_col*padded_rows + source_row] = image[image_col*image_rows + image_row];
-		}
+		kernel.fft_cols = cols + kernel_width - 1;
+		kernel.fft_lines = lines + kernel_height - 1;
+		int fft_size = kernel.fft_cols * kernel.fft_lines;
+		double scale_factor = 1.0 / fft_size;
+
+		FFTW_LOCK( kernel.spectrum = (fftwf_complex*) fftwf_malloc( sizeof( fftwf_complex ) * fft_size ); )
+		FFTW_LOCK( kernel.forward_plan = fftwf_plan_dft_2d( kernel.fft_lines, kernel.fft_cols, kernel.spectrum, kernel.spectrum, FFTW_FORWARD, FFTW_ESTIMATE ); )
+		FFTW_LOCK( kernel.inverse_plan = fftwf_plan_dft_2d( kernel.fft_lines, kernel.fft_cols, kernel.spectrum, kernel.spectrum, FFTW_BACKWARD, FFTW_ESTIMATE ); )
+
+		for( int i = 0; i < fft_size; i++ )
+			kernel.spectrum[i][0] = kernel.spectrum[i][1] = 0;
+		for( int y = 0; y < kernel_height; y++ )
+		for( int x = 0; x < kernel_width; x++ )
+			kernel.spectrum[y*kernel.fft_cols + x][0] = (float)( taps[y*kernel_width + x] * scale_factor );
+		fftwf_execute( kernel.forward_plan );
 	}
 
-	// perform convolution
-	for( source_col = col_pad; source_col  < padded_cols - col_pad; source_col++ )
-	{
-		int image_col = source_col - col_pad;
-		for( int source_row = row_pad; source_row < padded_rows - row_pad; source_row++ )
-		{
-			int image_row = source_row - row_pad;
+	// split images across the shared threads
+	ThreadPool* thread_pool = ThreadPool::Instance();
+	int num_threads = std::max( 1, std::min( thread_pool->NumThreads(), num_images ) );
+	int images_per_thread = (int)ceil( (float)num_images / num_threads );
 
-			// kernel loop
-			float pixel_value = 0;
-			float pixel_value_complex = 0;
+	std::vector<ConvArgs> args( num_threads );
+	for( int i = 0; i < num_threads; i++ )
+	{
+		args[i].kernel = &kernel;
+		args[i].images = images;
+		args[i].cols = cols;
+		args[i].lines = lines;
+		args[i].is_complex = is_complex;
+		args[i].first_image = std::min( i * images_per_thread, num_images );
+		args[i].last_image = std::min( ( i + 1 ) * images_per_thread, num_images );
+	}
 
-			for( int kernel_row = 0; kernel_row < kernel_rows; kernel_row++ )
-			{
-				for( int kernel_col = 0; kernel_col < kernel_cols; kernel_col++ )
-				{
-					int offset_row = -kernel_row + row_pad - 1;
-					int offset_col = -kernel_col + row_pad - 1;
-
-					int offset_source_row = source_row + offset_row;
-					int offset_source_col = source_col + offset_col;
-
-					if( image_is_complex ) {
-						pixel_value += kernel[kernel_col*kernel_rows + kernel_row] * source[2*(offset_source_col*padded_rows + offset_source_row)];
-						pixel_value_complex += kernel[kernel_col*kernel_rows + kernel_row] * source[2*(offset_source_col*padded_rows + offset_source_row) + 1];
-					}
-					else
-						pixel_value += kernel[kernel_col*kernel_rows + kernel_row] * source[offset_source_col*padded_rows + offset_source_row];
-				}
-			}
+	thread_pool->Run( ConvImages, args );
+}
 
-			// set value in image
-			if( image_is_complex )
-			{
-				dest[2*(image_col*image_rows + image_row)] = pixel_value;
-				dest[2*(image_col*image_rows + image_row) + 1] = pixel_value_complex;
-			}
-			else
-				dest[image_col*image_rows + image_row] = pixel_value;
-		}
+class FFTArgs
+{
+	public:
+	fftwf_plan plan;
+	fftwf_complex* data;
+	long batch_stride;
+	int first_batch;
+	int last_batch;
+};
+
+// worker for FilterTool::FFTDims, executes the shared plan on batches [first_batch, last_batch)
+static void* FFTBatches( void* args_ptr )
+{
+	FFTArgs* args = (FFTArgs*) args_ptr;
+	for( int i = args->first_batch; i < args->last_batch; i++ )
+	{
+		fftwf_complex* batch = args->data + i * args->batch_stride;
+		fftwf_execute_dft( args->plan, batch, batch );
 	}
+	return 0;
+}
 
-	delete [] source;
+static void AddIODim( std::vector<fftwf_iodim>& dims, int n, int stride )
+{
+	if( n < 2 )
+		return;
+	fftwf_iodim dim;
+	dim.n = n;
+	dim.is = stride;
+	dim.os = stride;
+	dims.push_back( dim );
 }
 
-void FilterTool::FFT1D_COL( MRIData& data_volume, bool reverse )
+void FilterTool::FFTDims( MRIData& data_volume, bool fft_column, bool fft_line, bool fft_partition, bool reverse )
 {
 	// only works on complex data
 	if( !data_volume.IsComplex() )
 		return;
 
-	int cols = data_volume.Size().Column;
-	int lines = data_volume.Size().Line;
-	int channels = data_volume.Size().Channel;
-	int sets = data_volume.Size().Set;
-	int phases = data_volume.Size().Phase;
-	int slices = data_volume.Size().Slice;
-	int echos = data_volume.Size().Echo;
-	int repetitions = data_volume.Size().Repetition;
-	int partitions = data_volume.Size().Partition;
-	int segments = data_volume.Size().Segment;
-	int averages = data_volume.Size().Average;
-
-	double scale_factor = 1.0 / cols;
-
-	// allocate memory for FFT
-	fftwf_complex *fft_buffer = (fftwf_complex*) fftwf_malloc( sizeof( fftwf_complex ) * cols );
+	// MRIData is column, line, [channel..repetition], partition, [segment, average] from fastest to slowest,
+	// so the dimensions that aren't transformed collapse into at most five strided loops
+	const MRIDimensions& size = data_volume.Size();
+	int line_stride = size.Column;
+	int middle_stride = line_stride * size.Line;
+	int middle_size = size.Channel * size.Set * size.Phase * size.Slice * size.Echo * size.Repetition;
+	int partition_stride = middle_stride * middle_size;
+	int outer_stride = partition_stride * size.Partition;
+	int outer_size = size.Segment * size.Average;
+
+	std::vector<fftwf_iodim> dims;
+	std::vector<fftwf_iodim> loops;
+	AddIODim( loops, outer_size, outer_stride );
+	AddIODim( ( fft_partition )? dims: loops, size.Partition, partition_stride );
+	AddIODim( loops, middle_size, middle_stride );
+	AddIODim( ( fft_line )? dims: loops, size.Line, line_stride );
+	AddIODim( ( fft_column )? dims: loops, size.Column, 1 );
+
+	// nothing to transform
+	if( dims.size() == 0 )
+		return;
 
-	// copy data so that the plan can find a algorithm
-	float* data = data_volume.GetDataIndex( 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
-	int i_buffer = 0, i_data = 0;
-	while( i_buffer < cols )
+	// the largest loop is split between threads, the rest are batched into the plan
+	int batches = 1;
+	long batch_stride = 0;
+	if( loops.size() > 0 )
 	{
-		fft_buffer[i_buffer][0] = data[i_data++];
-		fft_buffer[i_buffer++][1] = data[i_data++];
+		int thread_loop = 0;
+		for( int i = 1; i < (int)loops.size(); i++ )
+			if( loops[i].n > loops[thread_loop].n )
+				thread_loop = i;
+		batches = loops[thread_loop].n;
+		batch_stride = loops[thread_loop].is;
+		loops.erase( loops.begin() + thread_loop );
 	}
 
-	// create plan
+	// plan straight on the MRIData, FFTW_ESTIMATE leaves the data alone while planning
+	fftwf_complex* data = (fftwf_complex*)data_volume.GetDataStart();
 	int direction = ( reverse )? FFTW_BACKWARD: FFTW_FORWARD;
-	fftwf_plan plan = fftwf_plan_dft_1d( cols, fft_buffer, fft_buffer, direction, FFTW_MEASURE );
+	fftwf_plan plan;
+	FFTW_LOCK( plan = fftwf_plan_guru_dft( dims.size(), &dims[0], loops.size(), ( loops.size() > 0 )? &loops[0]: 0, data, data, direction, FFTW_ESTIMATE | FFTW_UNALIGNED ); )
+	if( plan == 0 )
+	{
+		GIRLogger::LogError( "FilterTool::FFTDims -> unable to create FFTW plan for %s!\n", size.ToString().c_str() );
+		return;
+	}
 
-	// iterate through all slices
-	for( int channel = 0; channel < channels; channel++ )
-	for( int set = 0; set < sets; set++ )
-	for( int phase = 0; phase < phases; phase++ )
-	for( int slice = 0; slice < slices; slice++ )
-	for( int echo = 0; echo < echos; echo++ )
-	for( int repetition = 0; repetition < repetitions; repetition++ )
-	for( int partition = 0; partition < partitions; partition++ )
-	for( int segment = 0; segment < segments; segment++ )
-	for( int average = 0; average < averages; average++ )
-	for( int line = 0; line < lines; line++ )
+	ThreadPool* thread_pool = ThreadPool::Instance();
+	int num_threads = std::max( 1, std::min( thread_pool->NumThreads(), batches ) );
+	int batches_per_thread = (int)ceil( (float)batches / num_threads );
+
+	std::vector<FFTArgs> args( num_threads );
+	for( int i = 0; i < num_threads; i++ )
 	{
-		// copy data to buffer
-		data = data_volume.GetDataIndex( 0, 0, channel, set, phase, slice, echo, repetition, partition, segment, average ) + line*cols*2;
-		int i_buffer = 0, i_data = 0;
-		while( i_buffer < cols )
-		{
-			fft_buffer[i_buffer][0] = data[i_data++];
-			fft_buffer[i_buffer++][1] = data[i_data++];
-		}
+		args[i].plan = plan;
+		args[i].data = data;
+		args[i].batch_stride = batch_stride;
+		args[i].first_batch = std::min( i * batches_per_thread, batches );
+		args[i].last_batch = std::min( ( i + 1 ) * batches_per_thread, batches );
+	}
 
-		// execute plan
-		fftwf_execute( plan );
+	thread_pool->Run( FFTBatches, args );
 
-		// copy data from buffer
-		i_buffer = 0, i_data =0;
-		while( i_buffer < cols )
-		{
-			if( reverse )
-			{
-				data[i_data++] = (float)(fft_buffer[i_buffer][0] * scale_factor);
-				data[i_data++] = (float)(fft_buffer[i_buffer++][1] * scale_factor);
-			}
-			else 
-			{
-				data[i_data++] = (float)fft_buffer[i_buffer][0];
-				data[i_data++] = (float)fft_buffer[i_buffer++][1];
-			}
-		}
+	FFTW_LOCK( fftwf_destroy_plan( plan ); )
+
+	// normalize inverse
+	if( reverse )
+	{
+		int transform_size = 1;
+		for( int i = 0; i < (int)dims.size(); i++ )
+			transform_size *= dims[i].n;
+		float scale_factor = 1.0f / transform_size;
+		float* scale_data = data_volume.GetDataStart();
+		for( int i = 0; i < data_volume.NumElements(); i++ )
+			scale_data[i] *= scale_factor;
 	}
+}
 
-	// free allocated memory
-	fftwf_destroy_plan( plan );
-	fftwf_free( fft_buffer );
+void FilterTool::FFT1D_COL( MRIData& data_volume, bool reverse )
+{
+	FFTDims( data_volume, true, false, false, reverse );
+}
+
+void FilterTool::FFT1D_PAR( MRIData& data_volume, bool reverse )
+{
+	FFTDims( data_volume, false, false, true, reverse );
+}
+
+void FilterTool::FFT3D( MRIData& data_volume, bool reverse )
+{
+	FFTDims( data_volume, true, true, true, reverse );
 }
 
 void FilterTool::FFT2D( float *dest, float *source, int cols, int lines, bool reverse ) {
@@ -313,81 +566,7 @@ void FilterTool::FFT2D( float *dest, float *source, int cols, int lines, bool re
 
 void FilterTool::FFT2D( MRIData& data_volume, bool reverse )
 {
-	// only works on complex data
-	if( !data_volume.IsComplex() )
-		return;
-
-	int cols = data_volume.Size().Column;
-	int lines = data_volume.Size().Line;
-	int channels = data_volume.Size().Channel;
-	int sets = data_volume.Size().Set;
-	int phases = data_volume.Size().Phase;
-	int slices = data_volume.Size().Slice;
-	int echos = data_volume.Size().Echo;
-	int repetitions = data_volume.Size().Repetition;
-	int partitions = data_volume.Size().Partition;
-	int segments = data_volume.Size().Segment;
-	int averages = data_volume.Size().Average;
-	double scale_factor = 1.0 / ( lines * cols );
-
-	// allocate memory for FFT
-	fftwf_complex *fft_buffer = (fftwf_complex*) fftwf_malloc( sizeof( fftwf_complex ) * cols * lines );
-
-	// copy data so that the plan can find a algorithm
-	float *data = data_volume.GetDataIndex( 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
-	int i_buffer = 0, i_data = 0;
-	while( i_buffer < cols * lines )
-	{
-		fft_buffer[i_buffer][0] = data[i_data++];
-		fft_buffer[i_buffer++][1] = data[i_data++];
-	}
-
-	// create plan
-	int direction = ( reverse )? FFTW_BACKWARD: FFTW_FORWARD;
-	//fftwf_plan plan = fftwf_plan_dft_2d( cols, lines, fft_buffer, fft_buffer, direction, FFTW_MEASURE );
-	fftwf_plan plan = fftwf_plan_dft_2d( lines, cols, fft_buffer, fft_buffer, direction, FFTW_MEASURE );
-
-	// iterate through all slices
-	for( int channel = 0; channel < channels; channel++ )
-	for( int set = 0; set < sets; set++ )
-	for( int phase = 0; phase < phases; phase++ )
-	for( int slice = 0; slice < slices; slice++ )
-	for( int echo = 0; echo < echos; echo++ )
-	for( int repetition = 0; repetition < repetitions; repetition++ )
-	for( int partition = 0; partition < partitions; partition++ )
-	for( int segment = 0; segment < segments; segment++ )
-	for( int average = 0; average < averages; average++ )
-	{
-		// copy data to buffer
-		data = data_volume.GetDataIndex( 0, 0, channel, set, phase, slice, echo, repetition, partition, segment, average );
-		int i_buffer = 0, i_data = 0;
-		while( i_buffer < cols * lines )
-		{
-			fft_buffer[i_buffer][0] = data[i_data++];
-			fft_buffer[i_buffer++][1] = data[i_data++];
-		}
-
-		// execute plan
-		fftwf_execute( plan );
-
-		// copy data from buffer
-		i_buffer = 0, i_data =0;
-		while( i_buffer < cols * lines )
-		{
-			if( reverse ) {
-				data[i_data++] = (float)(fft_buffer[i_buffer][0] * scale_factor);
-				data[i_data++] = (float)(fft_buffer[i_buffer++][1] * scale_factor);
-			}
-			else {
-				data[i_data++] = (float)fft_buffer[i_buffer][0];
-				data[i_data++] = (float)fft_buffer[i_buffer++][1];
-			}
-		}
-	}
-
-	// free allocated memory
-	fftwf_destroy_plan( plan );
-	fftwf_free( fft_buffer );
+	FFTDims( data_volume, true, true, false, reverse );
 }
 
 // this could be done more efficiently, especially if you can assume that all
@@ -472,6 +651,33 @@ void FilterTool::FFTShift( MRIData& dest, bool shift_lr, bool shift_ud, bool rev
 	delete [] slice_buffer;
 }
 
+void FilterTool::FFTShiftPartitions( MRIData& dest, bool reverse )
+{
+	int partitions = dest.Size().Partition;
+	int center_partition = (int)floor( partitions / 2 );
+	if( reverse && partitions % 2 == 1 )
+		center_partition++;
+	if( partitions < 2 || center_partition % partitions == 0 )
+		return;
+
+	// partitions are the slowest dimension after segment and average, so each one is a contiguous block
+	int block_size = dest.NumElements() / ( partitions * dest.Size().Segment * dest.Size().Average );
+
+	float* buffer = new float[block_size * partitions];
+	for( int average = 0; average < dest.Size().Average; average++ )
+	for( int segment = 0; segment < dest.Size().Segment; segment++ )
+	{
+		float* volume = dest.GetDataIndex( 0, 0, 0, 0, 0, 0, 0, 0, 0, segment, average );
+		memcpy( buffer, volume, block_size * partitions * sizeof( float ) );
+		for( int partition = 0; partition < partitions; partition++ )
+		{
+			int new_partition = ( partition + center_partition ) % partitions;
+			memcpy( volume + new_partition * block_size, buffer + partition * block_size, block_size * sizeof( float ) );
+		}
+	}
+	delete [] buffer;
+}
+
 void FilterTool::InitMutex() {
 	pthread_mutex_init( &Mutex, NULL );
 }
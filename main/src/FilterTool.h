@@ -20,13 +20,20 @@ class FilterTool {
 	public:
 		static void Conv2D( MRIData& image, float* kernel, int kernel_rows, int kernel_cols ); 
 		static void Conv2D( float* image, float *kernel, float *dest, int image_rows, int image_cols, int kernel_rows, int kernel_cols, bool image_is_complex, bool kernel_is_complex ); 
+		// convolves num_images contiguous row-major images in place, taps are row-major (kernel_height x kernel_width)
+		static void Conv2DImages( float* images, int num_images, int cols, int lines, bool is_complex, const float* taps, int kernel_width, int kernel_height, int origin_x, int origin_y );
 		//static void FFT1D( float* dest, float* source, int n, bool reverse = false );
 		static void FFT1D_COL( MRIData& data_volume, bool reverse = false );
+		static void FFT1D_PAR( MRIData& data_volume, bool reverse = false );
 		static void FFT2D( float *dest, float *source, int data_cols, int data_lines, bool reverse = false ); 
 		static void FFT2D( MRIData& data_volume, bool reverse = false ); 
+		static void FFT3D( MRIData& data_volume, bool reverse = false );
+		// transforms any combination of the column, line and partition dimensions of every image in data_volume
+		static void FFTDims( MRIData& data_volume, bool fft_column, bool fft_line, bool fft_partition, bool reverse = false );
 
 		static void FFTShift( MRIData& dest, bool reverse = false );
 		static void FFTShift( MRIData& dest, bool shift_lr, bool shift_ud, bool reverse = false );
+		static void FFTShiftPartitions( MRIData& dest, bool reverse = false );
 
 		static pthread_mutex_t Mutex;
 		static void InitMutex();
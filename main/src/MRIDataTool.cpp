@@ -79,7 +79,7 @@ bool MRIDataTool::GetCoilSense( const MRIData &estimate, MRIData& coil_sense )
 	return true;
 }
 
-void MRIDataTool::GetCoilMap( const MRIData &k_space, MRIData& coil_map )
+void MRIDataTool::GetCoilMap( const MRIData &k_space, MRIData& coil_map, bool normalize )
 {
 	int k_columns = k_space.Size().Column;
 	int k_lines = k_space.Size().Line;
@@ -187,6 +187,14 @@ void MRIDataTool::GetCoilMap( const MRIData &k_space, MRIData& coil_map )
 	// IFFT so we can create reference image
 	FilterTool::FFT2D( coil_map, true );
 
+	// the caller normalizes, e.g. over channels it doesn't hold
+	if( !normalize )
+	{
+		delete [] k_mask;
+		delete [] smooth_mask;
+		return;
+	}
+
 	// combine coils to create reference image
 	//TODO: can we get rid of this MRIData?
 	MRIDimensions coil_estimate_dimensions( k_columns, k_lines, k_channels, 1, 1, k_slices, 1, 1, 1, 1, 1 );
@@ -604,3 +612,34 @@ void MRIDataTool::GetPhaseContrastLambdaMap( const MRIData &image_estimate, MRID
 	lambda_map.Mult( -1 );
 	lambda_map.ScaleMax( 1 );
 }
+
+void MRIDataTool::CoilCombine( const MRIData& estimate, const MRIData& coil_map, MRIData& combined )
+{
+	MRIDimensions est_size = estimate.Size();
+	MRIDimensions combined_size = est_size;
+	combined_size.Channel = 1;
+	combined = MRIData( combined_size, true );
+	combined.SetAll( 0 );
+
+	int image_size = est_size.Column * est_size.Line;
+	int num_images = combined.NumPixels() / image_size;
+	float* est_data = estimate.GetDataStart();
+	float* coil_data = coil_map.GetDataStart();
+	float* combined_data = combined.GetDataStart();
+
+	for( int i = 0; i < num_images; i++ )
+	{
+		int slice = ( i / ( est_size.Set * est_size.Phase ) ) % est_size.Slice;
+		float* dest = combined_data + 2L * i * image_size;
+		for( int channel = 0; channel < est_size.Channel; channel++ )
+		{
+			float* src = est_data + 2L * ( (long)i * est_size.Channel + channel ) * image_size;
+			float* coil = coil_data + 2L * ( (long)slice * est_size.Channel + channel ) * image_size;
+			for( int j = 0; j < image_size; j++ )
+			{
+				dest[2*j] += src[2*j] * coil[2*j] + src[2*j+1] * coil[2*j+1];
+				dest[2*j+1] += src[2*j+1] * coil[2*j] - src[2*j] * coil[2*j+1];
+			}
+		}
+	}
+}
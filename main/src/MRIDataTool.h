@@ -8,9 +8,12 @@
 class MRIDataTool {
 	public:
 		static bool GetCoilSense( const MRIData &k_space, MRIData& coil_map );
-		static void GetCoilMap( const MRIData &k_space, MRIData& coil_map );
+		// without normalize the low resolution coil images are left undivided by their root sum of squares
+		static void GetCoilMap( const MRIData &k_space, MRIData& coil_map, bool normalize = true );
 		static void GetSampleMask( const MRIData &k_space, MRIData& sample_mask );
 		static void GetSSQImage( const MRIData &k_space, MRIData& image_estimate );
+		// sums the channels of estimate weighted by the conjugate coil sensitivities into a single channel
+		static void CoilCombine( const MRIData& estimate, const MRIData& coil_map, MRIData& combined );
 
 
 		// phase-contrast
@@ -1,12 +1,185 @@
 #include <RadialGridder.h>
 #include <MRIData.h>
+#include <FilterTool.h>
 #include <GIRLogger.h>
+#include <ThreadPool.h>
+#include <pthread.h>
 #include <math.h>
 #include <cmath>
 #include <iostream>
 #include <sstream>
 #include <string.h>
 #include <cstdio>
+#include <algorithm>
+
+// Kaiser-Bessel lookup table entries per grid point
+#define KB_LUT_SAMPLES 512
+// grid points along each side of the tiles samples are binned into, a tile of every image of a trajectory stays in cache while it's gridded
+#define GRID_TILE_SIZE 16
+// most images gridded together through the tiles, more than this and a tile of all of them stops fitting in cache
+#define GRID_BATCH_IMAGES 32
+
+// cached plans are dropped, least recently used first, once they take up more than this
+#define PLAN_CACHE_BYTES ( 512L * 1024 * 1024 )
+
+class GridArgs
+{
+	public:
+	const TrajectoryPlan* plan;
+	int num_images;
+	// sample s of image i is at samples[2*( s*num_images + i )], views that weren't acquired are zeroed
+	const float* samples;
+	// per image, whether the plan's density holds for it or it needs its own weights
+	const std::vector<bool>* own_weights;
+	const std::vector<bool>* use_view;
+	const std::vector<float*>* dest_images;
+	int dest_size;
+	bool flatten;
+
+	// tiles are pulled from *next_tile until they run out
+	int* next_tile;
+	pthread_mutex_t* tile_mutex;
+};
+
+class SlidingWindowArgs
+{
+	public:
+	const TrajectoryPlan* plan;
+	const MRIData* radial_data;
+	MRIData* dest_data;
+	// repetition 0 of the image to slide along
+	MRIDimensions image_index;
+	int window_views;
+	int view_step;
+	int frames;
+	bool flatten;
+};
+
+class DegridArgs
+{
+	public:
+	const TrajectoryPlan* plan;
+	const float* grid;
+	float* radial_image;
+	int first_view;
+	int last_view;
+};
+
+class PlanArgs
+{
+	public:
+	TrajectoryPlan* plan;
+	int first_view;
+	int last_view;
+};
+
+// modified Bessel function of the first kind, order 0
+static double BesselI0( double x )
+{
+	double sum = 1;
+	double term = 1;
+	double quarter_x_squared = x * x / 4;
+	for( int k = 1; k < 100; k++ )
+	{
+		term *= quarter_x_squared / ( (double)k * k );
+		sum += term;
+		if( term < sum * 1e-12 )
+			break;
+	}
+	return sum;
+}
+
+// index of the image'th Column x Line image in data of the given size
+static void GetImageIndex( int image, const MRIDimensions& size, MRIDimensions& index )
+{
+	index.Column = 0;
+	index.Line = 0;
+	index.Channel = image % size.Channel; image /= size.Channel;
+	index.Set = image % size.Set; image /= size.Set;
+	index.Phase = image % size.Phase; image /= size.Phase;
+	index.Slice = image % size.Slice; image /= size.Slice;
+	index.Echo = image % size.Echo; image /= size.Echo;
+	index.Repetition = image % size.Repetition; image /= size.Repetition;
+	index.Partition = image % size.Partition; image /= size.Partition;
+	index.Segment = image % size.Segment; image /= size.Segment;
+	index.Average = image;
+}
+
+// views without any signal weren't acquired and are left out of the grid and its weights
+static bool IsEmptyView( const float* radial_view, int columns )
+{
+	float total_signal = 0;
+	for( int ro_sample = 0; ro_sample < columns; ro_sample++ )
+	{
+		total_signal += fabs( radial_view[2*ro_sample] ) + fabs( radial_view[2*ro_sample+1] );
+	}
+	return ( total_signal < 1e-20 );
+}
+
+// grid points within kernel_radius of splat along one axis
+static inline void GetTapRange( double splat, float kernel_radius, int& first, int& last )
+{
+	first = (int)floor( splat - kernel_radius ) + 1;
+	last = (int)ceil( splat + kernel_radius ) - 1;
+}
+
+// fills in the taps of views [first_view, last_view), sample_taps has to be set up already
+static void* FillPlan( void* plan_args )
+{
+	PlanArgs* args = (PlanArgs*)plan_args;
+	TrajectoryPlan& plan = *args->plan;
+	int columns = plan.columns;
+	int center_sample = (int)floor( columns / 2.0f );
+	int grid_size = plan.grid_size;
+	int max_taps = (int)ceil( 2 * plan.kernel_radius ) + 1;
+	std::vector<float> weights_x( max_taps );
+	std::vector<float> weights_y( max_taps );
+
+	for( int view = args->first_view; view < args->last_view; view++ )
+	{
+		double theta = plan.angles[view];
+		double cos_theta = cos( -theta ) * plan.grid_scale;
+		double sin_theta = sin( -theta ) * plan.grid_scale;
+
+		for( int ro_sample = 0; ro_sample < columns; ro_sample++ )
+		{
+			int radius = ro_sample - center_sample;
+			double splat_x = radius*cos_theta + plan.grid_center;
+			double splat_y = radius*sin_theta + plan.grid_center;
+
+			int first_x, last_x, first_y, last_y;
+			GetTapRange( splat_x, plan.kernel_radius, first_x, last_x );
+			GetTapRange( splat_y, plan.kernel_radius, first_y, last_y );
+
+			for( int x = first_x; x <= last_x; x++ )
+				weights_x[x - first_x] = plan.kernel_lut[(int)( fabs( splat_x - x ) * plan.lut_scale + 0.5 )];
+			for( int y = first_y; y <= last_y; y++ )
+				weights_y[y - first_y] = plan.kernel_lut[(int)( fabs( splat_y - y ) * plan.lut_scale + 0.5 )];
+
+			int tap = plan.sample_taps[view*columns + ro_sample];
+			for( int y = first_y; y <= last_y; y++ )
+			{
+				int grid_y = ( plan.wrap )? ( y + grid_size ) % grid_size: y;
+				float weight_y = weights_y[y - first_y];
+				for( int x = first_x; x <= last_x; x++ )
+				{
+					int grid_x = ( plan.wrap )? ( x + grid_size ) % grid_size: x;
+					plan.tap_index[tap] = grid_y*grid_size + grid_x;
+					plan.tap_weight[tap] = weight_y * weights_x[x - first_x];
+					tap++;
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+long TrajectoryPlan::Bytes() const
+{
+	return sizeof( int ) * ( sample_taps.size() + tap_index.size() + tile_taps.size() + binned_sample.size() + binned_index.size() ) +
+		sizeof( float ) * ( tap_weight.size() + density.size() + binned_weight.size() );
+}
 
 RadialGridder::~RadialGridder()
 {
@@ -14,180 +187,832 @@ RadialGridder::~RadialGridder()
 
 bool RadialGridder::Grid( const MRIData& radial_data, MRIData& cart_data, InterpKernelType kernel_type, int kernel_size, bool flatten )
 {
-	// set up gridding kernel
-	Initialize( kernel_type, kernel_size );
+	if( !radial_data.IsComplex() )
+	{
+		GIRLogger::LogError( "RadialGridder::Grid -> radial_data must be complex, aborting!\n" );
+		return false;
+	}
+
+	// set up gridding kernel and grid
+	int grid_size;
+	double grid_center;
+	double grid_scale;
+	bool deapodize;
+	if( !SetUpGrid( radial_data.Size().Column, kernel_type, kernel_size, grid_size, grid_center, grid_scale, deapodize ) )
+		return false;
 
 	// set up cart_dat
-	MRIDimensions cart_size( radial_data.Size().Column, radial_data.Size().Column, radial_data.Size().Channel, radial_data.Size().Set, radial_data.Size().Phase, radial_data.Size().Slice, radial_data.Size().Echo, radial_data.Size().Repetition, radial_data.Size().Partition, radial_data.Size().Segment, radial_data.Size().Average );
+	MRIDimensions cart_size = radial_data.Size();
+	cart_size.Line = cart_size.Column;
 	cart_data = MRIData( cart_size, radial_data.IsComplex() );
 
-	// create temporary padded data for gridding
-	MRIDimensions padded_size( radial_data.Size().Column+1, radial_data.Size().Column+1, 1, 1, 1, 1, 1, 1, 1, 1, 1 );
-	MRIData padded_dest( padded_size, radial_data.IsComplex() );
-	// may or may not be used, depending on flatten
-	MRIData padded_ones( padded_size, false );
-
-	// calculate some important values
-	//double delta_theta = (double)(M_PI / radial_data.Size().Line );
-	int center_sample = (int)floor( radial_data.Size().Column/ 2.0f );
-	double golden_angle = M_PI * ( ( sqrt( 5 ) - 1 ) / 2 );
+	int columns = radial_data.Size().Column;
+	MRIData oversampled_data;
+	if( deapodize )
+	{
+		MRIDimensions oversampled_size = radial_data.Size();
+		oversampled_size.Column = grid_size;
+		oversampled_size.Line = grid_size;
+		oversampled_data = MRIData( oversampled_size, true );
+		GIRLogger::LogDebug( "### gridding onto %dx%d for %dx%d...\n", grid_size, grid_size, columns, columns );
+	}
+	MRIData& dest_data = ( deapodize )? oversampled_data: cart_data;
 
 	if( repetition_offset != 0 )
 		GIRLogger::LogDebug( "### using repetition_offset: %d...\n", repetition_offset );
 
+	// images acquired along the same views share a plan
+	std::vector< std::vector<double> > group_angles;
+	std::vector< std::vector<int> > group_images;
+	GroupImages( radial_data.Size(), group_angles, group_images );
 
-	// iterate through each view
-	for( int average = 0; average < radial_data.Size().Average; average++ )
-	for( int segment = 0; segment < radial_data.Size().Segment; segment++ )
-	for( int partition = 0; partition < radial_data.Size().Partition; partition++ )
-	for( int repetition = 0; repetition < radial_data.Size().Repetition; repetition++ )
-	for( int echo = 0; echo < radial_data.Size().Echo; echo++ )
-	for( int channel = 0; channel < radial_data.Size().Channel; channel++ )
-	for( int set = 0; set < radial_data.Size().Set; set++ )
-	for( int phase = 0; phase < radial_data.Size().Phase; phase++ )
-	for( int slice = 0; slice < radial_data.Size().Slice; slice++ )
+	// tiles of the grid are independent, so the threads take whole tiles and grid every image of a trajectory
+	// into them at once, reading all the images' samples for a tap together
+	ThreadPool* thread_pool = ThreadPool::Instance();
+	int num_threads = thread_pool->NumThreads();
+	int views = radial_data.Size().Line;
+	int num_samples = views * columns;
+	MRIDimensions index;
+	for( int group_index = 0; group_index < (int)group_angles.size(); group_index++ )
 	{
-		// clear temporary data
-		padded_dest.SetAll( 0 );
-		padded_ones.SetAll( 0 );
-
-		// grid each line
-		for( int view = 0; view < radial_data.Size().Line; view++ ) 
+		const TrajectoryPlan* plan = GetPlan( group_angles[group_index], columns, grid_size, grid_center, grid_scale, deapodize );
+		const std::vector<int>& group = group_images[group_index];
+		for( int first_image = 0; first_image < (int)group.size(); first_image += GRID_BATCH_IMAGES )
 		{
-			float* radial_begin = radial_data.GetDataIndex( 0, view, channel, set, phase, slice, echo, repetition, partition, segment, average ) ;
+			std::vector<int> images( group.begin() + first_image, group.begin() + std::min( (int)group.size(), first_image + GRID_BATCH_IMAGES ) );
+			int num_images = images.size();
 
-			// skip empty lines
-			float total_signal = 0;
-			for( int ro_sample = 0; ro_sample < radial_data.Size().Column; ro_sample++ )
+			// interleave the images' samples, leaving out views without signal
+			std::vector<float> samples( 2L * num_samples * num_images );
+			std::vector<bool> use_view( views * num_images );
+			std::vector<bool> own_weights( num_images );
+			std::vector<float*> dest_images( num_images );
+			for( int i = 0; i < num_images; i++ )
 			{
-				total_signal += fabs( radial_begin[2*ro_sample] ) + fabs( radial_begin[2*ro_sample+1] );
+				GetImageIndex( images[i], radial_data.Size(), index );
+				const float* radial_image = radial_data.GetDataIndex( index );
+				dest_images[i] = dest_data.GetDataIndex( index );
+
+				bool all_views = true;
+				for( int view = 0; view < views; view++ )
+				{
+					bool use = !IsEmptyView( radial_image + 2 * view * columns, columns );
+					use_view[view*num_images + i] = use;
+					all_views = all_views && use;
+					for( int sample = view*columns; sample < ( view + 1 )*columns; sample++ )
+					{
+						samples[2L * ( sample*num_images + i )] = ( use )? radial_image[2*sample]: 0;
+						samples[2L * ( sample*num_images + i ) + 1] = ( use )? radial_image[2*sample+1]: 0;
+					}
+				}
+				own_weights[i] = ( flatten && !all_views );
 			}
-			if( total_signal < 1e-20 )
-				continue;
 
-			double theta_offset = 0;
-			double theta = 0;
+			int next_tile = 0;
+			pthread_mutex_t tile_mutex;
+			pthread_mutex_init( &tile_mutex, NULL );
 
-			// view ordering
-			if( view_ordering == VO_JORDAN_JITTER )
+			int num_tiles = plan->tiles_per_row * plan->tiles_per_row;
+			std::vector<GridArgs> args( std::max( 1, std::min( num_threads, num_tiles ) ) );
+			for( int i = 0; i < (int)args.size(); i++ )
 			{
-				int phases = radial_data.Size().Phase;
-				int radial_views = radial_data.Size().Line;
+				args[i].plan = plan;
+				args[i].num_images = num_images;
+				args[i].samples = &samples[0];
+				args[i].own_weights = &own_weights;
+				args[i].use_view = &use_view;
+				args[i].dest_images = &dest_images;
+				args[i].dest_size = dest_data.Size().Column;
+				args[i].flatten = flatten;
+				args[i].next_tile = &next_tile;
+				args[i].tile_mutex = &tile_mutex;
+			}
+			thread_pool->Run( GridThread, args );
 
-				int center_phase = (int)ceil( phases / 2 ) ;
-				int phase_order;
-				if( phase % 2 == 0 )
-					phase_order = (int)ceil(phase/2);
-				else
-					phase_order = (int)ceil((phase-1)/2) + center_phase;
-	
-				double jitter_theta = M_PI / ( radial_views * phases );
-				double delta_theta= (double)(M_PI / radial_views );
+			pthread_mutex_destroy( &tile_mutex );
+		}
+	}
+
+	if( deapodize )
+		Deapodize( oversampled_data, cart_data, flatten );
+
+	return true;
+}
+
+bool RadialGridder::GridSlidingWindow( const MRIData& radial_data, MRIData& cart_data, InterpKernelType kernel_type, int kernel_size, int window_views, int view_step, bool flatten )
+{
+	const MRIDimensions& radial_size = radial_data.Size();
+	int views = radial_size.Line;
+	int stream_views = views * radial_size.Repetition;
+	if( !radial_data.IsComplex() || window_views < 1 || view_step < 1 || window_views > stream_views )
+	{
+		GIRLogger::LogError( "RadialGridder::GridSlidingWindow -> can't slide a window of %d views by %d over %d complex views, aborting!\n", window_views, view_step, stream_views );
+		return false;
+	}
 
-				theta_offset = jitter_theta * phase_order;
-				theta = view * delta_theta + theta_offset;
+	// set up gridding kernel and grid
+	int grid_size;
+	double grid_center;
+	double grid_scale;
+	bool deapodize;
+	if( !SetUpGrid( radial_size.Column, kernel_type, kernel_size, grid_size, grid_center, grid_scale, deapodize ) )
+		return false;
+
+	int columns = radial_size.Column;
+	int frames = ( stream_views - window_views ) / view_step + 1;
+	MRIDimensions cart_size = radial_size;
+	cart_size.Line = cart_size.Column;
+	cart_size.Repetition = frames;
+	cart_data = MRIData( cart_size, true );
+
+	MRIData oversampled_data;
+	if( deapodize )
+	{
+		MRIDimensions oversampled_size = cart_size;
+		oversampled_size.Column = grid_size;
+		oversampled_size.Line = grid_size;
+		oversampled_data = MRIData( oversampled_size, true );
+	}
+	MRIData& dest_data = ( deapodize )? oversampled_data: cart_data;
+	GIRLogger::LogDebug( "### sliding %d views by %d over %d views, %d frames...\n", window_views, view_step, stream_views, frames );
+
+	// every phase is its own stream of views with one plan over all of them, each image slides its own window
+	ThreadPool* thread_pool = ThreadPool::Instance();
+	MRIDimensions image_size = radial_size;
+	image_size.Phase = 1;
+	image_size.Repetition = 1;
+	int phase_images = image_size.Channel * image_size.Set * image_size.Slice * image_size.Echo * image_size.Partition * image_size.Segment * image_size.Average;
+	std::vector<double> stream_angles( stream_views );
+	for( int phase = 0; phase < radial_size.Phase; phase++ )
+	{
+		for( int view = 0; view < stream_views; view++ )
+			stream_angles[view] = GetViewAngle( view % views, phase, view / views, radial_size );
+		const TrajectoryPlan* plan = GetPlan( stream_angles, columns, grid_size, grid_center, grid_scale, deapodize );
+
+		std::vector<SlidingWindowArgs> args( phase_images );
+		for( int i = 0; i < phase_images; i++ )
+		{
+			args[i].plan = plan;
+			args[i].radial_data = &radial_data;
+			args[i].dest_data = &dest_data;
+			GetImageIndex( i, image_size, args[i].image_index );
+			args[i].image_index.Phase = phase;
+			args[i].window_views = window_views;
+			args[i].view_step = view_step;
+			args[i].frames = frames;
+			args[i].flatten = flatten;
+		}
+		thread_pool->Run( SlidingWindowThread, args );
+	}
+
+	if( deapodize )
+		Deapodize( oversampled_data, cart_data, flatten );
+
+	return true;
+}
+
+void* RadialGridder::SlidingWindowThread( void* window_args )
+{
+	SlidingWindowArgs* args = (SlidingWindowArgs*)window_args;
+	const TrajectoryPlan& plan = *args->plan;
+	int grid_size = plan.grid_size;
+	int columns = plan.columns;
+	int views = args->radial_data->Size().Line;
+	int dest_size = args->dest_data->Size().Column;
+
+	// running sums in double so that taking views back out doesn't drift over long series
+	std::vector<double> grid( 2 * grid_size * grid_size, 0 );
+	std::vector<double> weights( ( args->flatten )? grid_size * grid_size: 0, 0 );
+	double* weights_ptr = ( args->flatten )? &weights[0]: 0;
+
+	MRIDimensions index = args->image_index;
+	int window_start = 0;
+	int window_end = 0;
+	for( int frame = 0; frame < args->frames; frame++ )
+	{
+		int new_start = frame * args->view_step;
+		int new_end = new_start + args->window_views;
+
+		// entering views, then leaving ones
+		for( int view = std::max( window_end, new_start ); view < new_end; view++ )
+		{
+			index.Line = view % views;
+			index.Repetition = view / views;
+			const float* radial_view = args->radial_data->GetDataIndex( index );
+			if( !IsEmptyView( radial_view, columns ) )
+				AccumulateView( plan, view, radial_view, 1, &grid[0], weights_ptr );
+		}
+		for( int view = window_start; view < std::min( window_end, new_start ); view++ )
+		{
+			index.Line = view % views;
+			index.Repetition = view / views;
+			const float* radial_view = args->radial_data->GetDataIndex( index );
+			if( !IsEmptyView( radial_view, columns ) )
+				AccumulateView( plan, view, radial_view, -1, &grid[0], weights_ptr );
+		}
+		window_start = new_start;
+		window_end = new_end;
+
+		// get rid of padding and flatten
+		index.Line = 0;
+		index.Repetition = frame;
+		float* dest_image = args->dest_data->GetDataIndex( index );
+		for( int y = 0; y < dest_size; y++ )
+		for( int x = 0; x < dest_size; x++ )
+		{
+			int grid_index = y*grid_size + x;
+			int dest_index = y*dest_size + x;
+			// anything this small is what's left over from views that were taken back out
+			double ones_value = ( args->flatten )? weights[grid_index]: 0;
+			if( ones_value > 1e-10 )
+			{
+				dest_image[2*dest_index] = (float)( grid[2*grid_index] / ones_value );
+				dest_image[2*dest_index+1] = (float)( grid[2*grid_index+1] / ones_value );
 			}
-			else if( view_ordering == VO_GOLDEN_RATIO )
+			else
 			{
-				//int view_index = (repetition+repetition_offset)*radial_data.Size().Line+ view;
-				int view_index = (repetition+phase)*radial_data.Size().Line+ view;
-				theta = view_index*golden_angle;
-				theta = fmod( theta, M_PI );
+				dest_image[2*dest_index] = (float)grid[2*grid_index];
+				dest_image[2*dest_index+1] = (float)grid[2*grid_index+1];
 			}
-			else if( view_ordering == VO_GOLDEN_RATIO_NO_PHASE )
+		}
+	}
+
+	return 0;
+}
+
+void RadialGridder::AccumulateView( const TrajectoryPlan& plan, int view, const float* radial_view, double sign, double* grid, double* weights )
+{
+	int columns = plan.columns;
+	const int* tap_index = &plan.tap_index[0];
+	const float* tap_weight = &plan.tap_weight[0];
+	for( int ro_sample = 0; ro_sample < columns; ro_sample++ )
+	{
+		int sample = view*columns + ro_sample;
+		double real = sign * radial_view[2*ro_sample];
+		double imag = sign * radial_view[2*ro_sample+1];
+		for( int tap = plan.sample_taps[sample]; tap < plan.sample_taps[sample+1]; tap++ )
+		{
+			int grid_index = tap_index[tap];
+			grid[2*grid_index] += real * tap_weight[tap];
+			grid[2*grid_index+1] += imag * tap_weight[tap];
+			if( weights != 0 )
+				weights[grid_index] += sign * tap_weight[tap];
+		}
+	}
+}
+
+bool RadialGridder::Degrid( const MRIData& cart_data, MRIData& radial_data, InterpKernelType kernel_type, int kernel_size )
+{
+	const MRIDimensions& cart_size = cart_data.Size();
+	MRIDimensions radial_size = radial_data.Size();
+	radial_size.Line = radial_size.Column;
+	if( !cart_data.IsComplex() || !radial_data.IsComplex() || cart_size.Line != cart_size.Column || !radial_size.Equals( cart_size ) )
+	{
+		GIRLogger::LogError( "RadialGridder::Degrid -> cart_data %s doesn't fit radial_data %s, both must be complex and allocated!\n", cart_size.ToString().c_str(), radial_data.Size().ToString().c_str() );
+		return false;
+	}
+
+	// set up gridding kernel and grid
+	int grid_size;
+	double grid_center;
+	double grid_scale;
+	bool deapodize;
+	if( !SetUpGrid( cart_size.Column, kernel_type, kernel_size, grid_size, grid_center, grid_scale, deapodize ) )
+		return false;
+
+	// cartesian k-space onto the grid the samples are interpolated from, exactly the adjoint of the way Grid gets off of it
+	int columns = cart_size.Column;
+	MRIDimensions padded_size = cart_size;
+	padded_size.Column = grid_size;
+	padded_size.Line = grid_size;
+	MRIData padded_data( padded_size, true );
+	if( deapodize )
+		Apodize( cart_data, padded_data );
+	else
+	{
+		padded_data.SetAll( 0 );
+		int num_images = cart_data.NumPixels() / ( columns * columns );
+		for( int image = 0; image < num_images; image++ )
+		for( int y = 0; y < columns; y++ )
+			memcpy( padded_data.GetDataStart() + 2L * ( image * grid_size + y ) * grid_size, cart_data.GetDataStart() + 2L * ( image * columns + y ) * columns, sizeof( float ) * 2 * columns );
+	}
+
+	std::vector< std::vector<double> > group_angles;
+	std::vector< std::vector<int> > group_images;
+	GroupImages( radial_data.Size(), group_angles, group_images );
+
+	// samples only read the grid, so images and views are all independent
+	ThreadPool* thread_pool = ThreadPool::Instance();
+	int views = radial_data.Size().Line;
+	MRIDimensions index;
+	for( int group = 0; group < (int)group_angles.size(); group++ )
+	{
+		const TrajectoryPlan* plan = GetPlan( group_angles[group], columns, grid_size, grid_center, grid_scale, deapodize );
+		const std::vector<int>& images = group_images[group];
+		int view_blocks = std::min( views, std::max( 1, thread_pool->NumThreads() / (int)images.size() ) );
+
+		std::vector<DegridArgs> args( images.size() * view_blocks );
+		for( int i = 0; i < (int)images.size(); i++ )
+		{
+			GetImageIndex( images[i], radial_data.Size(), index );
+			for( int block = 0; block < view_blocks; block++ )
 			{
-				int view_index = view;
-				theta = view_index*golden_angle;
-				theta = fmod( theta, M_PI );
+				DegridArgs& job = args[i*view_blocks + block];
+				job.plan = plan;
+				job.grid = padded_data.GetDataIndex( index );
+				job.radial_image = radial_data.GetDataIndex( index );
+				job.first_view = views * block / view_blocks;
+				job.last_view = views * ( block + 1 ) / view_blocks;
 			}
+		}
+		thread_pool->Run( DegridThread, args );
+	}
 
-			double cos_theta = cos( -theta );
-			double sin_theta = sin( -theta );
+	return true;
+}
+
+bool RadialGridder::GetToeplitzKernel( const MRIDimensions& radial_size, MRIData& kernel_data, InterpKernelType kernel_type, int kernel_size )
+{
+	// the point spread function spans twice the field of view, so unit samples go along the same views onto a
+	// 2*Column grid, every other read out sample at the original radius and the ones in between left at zero
+	int columns = radial_size.Column;
+	int center_sample = (int)floor( columns / 2.0f );
+	MRIDimensions unit_size( 2 * columns, radial_size.Line, 1, 1, radial_size.Phase, 1, 1, radial_size.Repetition, 1, 1, 1 );
+	MRIData unit_data( unit_size, true );
+	unit_data.SetAll( 0 );
+	float* unit_samples = unit_data.GetDataStart();
+	int num_views = unit_data.NumPixels() / unit_size.Column;
+	for( int view = 0; view < num_views; view++ )
+	for( int ro_sample = 0; ro_sample < columns; ro_sample++ )
+		unit_samples[2L * ( view * unit_size.Column + 2 * ( ro_sample - center_sample ) + columns )] = 1;
 
-			// splat each sample
-			for( int ro_sample = 0; ro_sample < radial_data.Size().Column; ro_sample++ )
+	if( !Grid( unit_data, kernel_data, kernel_type, kernel_size, false ) )
+		return false;
+
+	// the inverse FFT on the 2*Column grid divides by 4 times as much as the one on Column x Column
+	FilterTool::FFTShift( kernel_data );
+	float* kernel = kernel_data.GetDataStart();
+	for( int i = 0; i < kernel_data.NumElements(); i++ )
+		kernel[i] *= 4;
+
+	return true;
+}
+
+bool RadialGridder::SetUpGrid( int columns, InterpKernelType kernel_type, int kernel_size, int& grid_size, double& grid_center, double& grid_scale, bool& deapodize )
+{
+	if( oversampling < 1 )
+	{
+		GIRLogger::LogError( "RadialGridder::SetUpGrid -> oversampling must be at least 1, changed from %f to 1...\n", oversampling );
+		oversampling = 1;
+	}
+
+	// set up gridding kernel
+	if( !Initialize( kernel_type, kernel_size ) )
+		return false;
+
+	// bilinear at the native resolution grids straight into cart_data like it always has, anything
+	// else grids onto a periodic (over)sampled grid and gets deapodized back down to Column x Column
+	deapodize = ( kernel_type != KERN_TYPE_BILINEAR || oversampling > 1 );
+	if( deapodize )
+	{
+		grid_size = 2 * (int)ceil( oversampling * columns / 2.0 );
+		grid_center = grid_size / 2;
+		grid_scale = (double)grid_size / columns;
+	}
+	else
+	{
+		grid_size = columns + 1;
+		grid_center = floor( columns / 2.0f );
+		grid_scale = 1;
+	}
+
+	return true;
+}
+
+void RadialGridder::GroupImages( const MRIDimensions& size, std::vector< std::vector<double> >& group_angles, std::vector< std::vector<int> >& group_images ) const
+{
+	// at most one group per phase and repetition
+	group_angles.clear();
+	group_images.clear();
+	std::vector<int> phase_group( size.Phase * size.Repetition );
+	std::vector<double> angles( size.Line );
+	for( int repetition = 0; repetition < size.Repetition; repetition++ )
+	for( int phase = 0; phase < size.Phase; phase++ )
+	{
+		for( int view = 0; view < size.Line; view++ )
+			angles[view] = GetViewAngle( view, phase, repetition, size );
+
+		int group = 0;
+		while( group < (int)group_angles.size() && group_angles[group] != angles )
+			group++;
+		if( group == (int)group_angles.size() )
+		{
+			group_angles.push_back( angles );
+			group_images.push_back( std::vector<int>() );
+		}
+		phase_group[repetition*size.Phase + phase] = group;
+	}
+
+	int num_images = size.Channel * size.Set * size.Phase * size.Slice * size.Echo * size.Repetition * size.Partition * size.Segment * size.Average;
+	MRIDimensions index;
+	for( int image = 0; image < num_images; image++ )
+	{
+		GetImageIndex( image, size, index );
+		group_images[phase_group[index.Repetition*size.Phase + index.Phase]].push_back( image );
+	}
+}
+
+const TrajectoryPlan* RadialGridder::GetPlan( const std::vector<double>& angles, int columns, int grid_size, double grid_center, double grid_scale, bool wrap )
+{
+	for( std::list<TrajectoryPlan>::iterator plan = plans.begin(); plan != plans.end(); plan++ )
+	{
+		if( plan->columns == columns && plan->grid_size == grid_size && plan->grid_center == grid_center && plan->grid_scale == grid_scale && plan->wrap == wrap &&
+			plan->kernel_radius == kernel_radius && plan->lut_scale == lut_scale && plan->kernel_lut == kernel_lut && plan->angles == angles )
+		{
+			plans.splice( plans.end(), plans, plan );
+			return &plans.back();
+		}
+	}
+
+	// make room
+	long cached_bytes = 0;
+	for( std::list<TrajectoryPlan>::iterator plan = plans.begin(); plan != plans.end(); plan++ )
+		cached_bytes += plan->Bytes();
+	while( !plans.empty() && cached_bytes > PLAN_CACHE_BYTES )
+	{
+		cached_bytes -= plans.front().Bytes();
+		plans.pop_front();
+	}
+
+	plans.push_back( TrajectoryPlan() );
+	TrajectoryPlan& plan = plans.back();
+	plan.columns = columns;
+	plan.angles = angles;
+	plan.grid_size = grid_size;
+	plan.grid_center = grid_center;
+	plan.grid_scale = grid_scale;
+	plan.wrap = wrap;
+	plan.kernel_radius = kernel_radius;
+	plan.lut_scale = lut_scale;
+	plan.kernel_lut = kernel_lut;
+	BuildPlan( plan );
+
+	return &plan;
+}
+
+void RadialGridder::BuildPlan( TrajectoryPlan& plan )
+{
+	int columns = plan.columns;
+	int views = plan.Views();
+	int center_sample = (int)floor( columns / 2.0f );
+
+	// count taps
+	plan.sample_taps.resize( views * columns + 1 );
+	int num_taps = 0;
+	for( int view = 0; view < views; view++ )
+	{
+		double cos_theta = cos( -plan.angles[view] ) * plan.grid_scale;
+		double sin_theta = sin( -plan.angles[view] ) * plan.grid_scale;
+		for( int ro_sample = 0; ro_sample < columns; ro_sample++ )
+		{
+			int radius = ro_sample - center_sample;
+			int first_x, last_x, first_y, last_y;
+			GetTapRange( radius*cos_theta + plan.grid_center, plan.kernel_radius, first_x, last_x );
+			GetTapRange( radius*sin_theta + plan.grid_center, plan.kernel_radius, first_y, last_y );
+
+			plan.sample_taps[view*columns + ro_sample] = num_taps;
+			num_taps += std::max( 0, last_x - first_x + 1 ) * std::max( 0, last_y - first_y + 1 );
+		}
+	}
+	plan.sample_taps[views*columns] = num_taps;
+	plan.tap_index.resize( num_taps );
+	plan.tap_weight.resize( num_taps );
+
+	// fill them in
+	ThreadPool* thread_pool = ThreadPool::Instance();
+	int num_jobs = std::max( 1, std::min( thread_pool->NumThreads(), views ) );
+	std::vector<PlanArgs> args( num_jobs );
+	for( int i = 0; i < num_jobs; i++ )
+	{
+		args[i].plan = &plan;
+		args[i].first_view = views * i / num_jobs;
+		args[i].last_view = views * ( i + 1 ) / num_jobs;
+	}
+	thread_pool->Run( FillPlan, args );
+
+	// density of every sample
+	plan.density.assign( plan.grid_size * plan.grid_size, 0 );
+	for( int tap = 0; tap < num_taps; tap++ )
+		plan.density[plan.tap_index[tap]] += plan.tap_weight[tap];
+
+	BinPlan( plan );
+
+	GIRLogger::LogDebug( "### built trajectory plan: %d views, %d taps, %ld bytes...\n", views, num_taps, plan.Bytes() );
+}
+
+void RadialGridder::BinPlan( TrajectoryPlan& plan )
+{
+	int grid_size = plan.grid_size;
+	int num_samples = plan.Views() * plan.columns;
+	plan.tile_size = GRID_TILE_SIZE;
+	plan.tiles_per_row = ( grid_size + plan.tile_size - 1 ) / plan.tile_size;
+	int num_tiles = plan.tiles_per_row * plan.tiles_per_row;
+
+	// count taps per tile
+	plan.tile_taps.assign( num_tiles + 1, 0 );
+	for( int tap = 0; tap < (int)plan.tap_index.size(); tap++ )
+	{
+		int grid_index = plan.tap_index[tap];
+		int tile = ( grid_index / grid_size / plan.tile_size ) * plan.tiles_per_row + ( grid_index % grid_size ) / plan.tile_size;
+		plan.tile_taps[tile + 1]++;
+	}
+	for( int tile = 0; tile < num_tiles; tile++ )
+		plan.tile_taps[tile + 1] += plan.tile_taps[tile];
+
+	// and drop them in, going through the samples in order
+	std::vector<int> next_tap( plan.tile_taps.begin(), plan.tile_taps.end() - 1 );
+	plan.binned_sample.resize( plan.tap_index.size() );
+	plan.binned_index.resize( plan.tap_index.size() );
+	plan.binned_weight.resize( plan.tap_index.size() );
+	for( int sample = 0; sample < num_samples; sample++ )
+	for( int tap = plan.sample_taps[sample]; tap < plan.sample_taps[sample+1]; tap++ )
+	{
+		int grid_index = plan.tap_index[tap];
+		int tile = ( grid_index / grid_size / plan.tile_size ) * plan.tiles_per_row + ( grid_index % grid_size ) / plan.tile_size;
+		int binned = next_tap[tile]++;
+		plan.binned_sample[binned] = sample;
+		plan.binned_index[binned] = grid_index;
+		plan.binned_weight[binned] = plan.tap_weight[tap];
+	}
+}
+
+void* RadialGridder::GridThread( void* grid_args )
+{
+	GridArgs* args = (GridArgs*)grid_args;
+	const TrajectoryPlan& plan = *args->plan;
+	int grid_size = plan.grid_size;
+	int columns = plan.columns;
+	int tile_size = plan.tile_size;
+	int num_images = args->num_images;
+	int dest_size = args->dest_size;
+	const std::vector<bool>& own_weights = *args->own_weights;
+	const std::vector<bool>& use_view = *args->use_view;
+
+	bool any_own_weights = false;
+	for( int i = 0; i < num_images; i++ )
+		any_own_weights = any_own_weights || own_weights[i];
+
+	// one tile of every image, image fastest
+	std::vector<float> tile_grid( 2 * tile_size * tile_size * num_images );
+	std::vector<float> tile_weights( ( any_own_weights )? tile_size * tile_size * num_images: 0 );
+
+	while( true )
+	{
+		pthread_mutex_lock( args->tile_mutex );
+		int tile = (*args->next_tile)++;
+		pthread_mutex_unlock( args->tile_mutex );
+		if( tile >= plan.tiles_per_row * plan.tiles_per_row )
+			break;
+
+		int first_y = ( tile / plan.tiles_per_row ) * tile_size;
+		int first_x = ( tile % plan.tiles_per_row ) * tile_size;
+		std::fill( tile_grid.begin(), tile_grid.end(), 0.0f );
+		std::fill( tile_weights.begin(), tile_weights.end(), 0.0f );
+
+		// splat
+		for( int tap = plan.tile_taps[tile]; tap < plan.tile_taps[tile+1]; tap++ )
+		{
+			int grid_index = plan.binned_index[tap];
+			int local = ( grid_index / grid_size - first_y ) * tile_size + grid_index % grid_size - first_x;
+			int sample = plan.binned_sample[tap];
+			float kern_value = plan.binned_weight[tap];
+
+			const float* radial = args->samples + 2L * sample * num_images;
+			float* grid = &tile_grid[2 * local * num_images];
+			for( int i = 0; i < num_images; i++ )
 			{
-				int radius = ro_sample - center_sample;
-				double splat_x = radius*cos_theta + center_sample;
-				double splat_y = radius*sin_theta + center_sample;
-	
-				//GIRLogger::LogInfo( "center_sample: %d, splat_x: %f, splat_y: %f\n", center_sample, splat_x, splat_y );
-	
-				int top = (int)ceil( splat_y );
-				int bottom = (int)floor( splat_y );
-				int right = (int)ceil( splat_x );
-				int left = (int)floor( splat_x );
-	
-				//GIRLogger::LogInfo( "\ttop: %d, bottom: %d, left: %d, right: %d\n", top, bottom, left, right );
-	
-				//!this pointer should probably just be incremented to be faster...
-				//float* radial = radial_data.GetDataIndex( ro_sample, view, channel, set, phase, slice, echo, repetition, partition, segment, average ) ;
-				float* radial = radial_begin + (2*ro_sample);
-	
-				if( top == bottom && left == right )
-				{
-					Splat( padded_dest, padded_ones, radial, left, top, splat_x-left, splat_y-top, flatten );
-				}
-				else if( top == bottom ) 
-				{
-					Splat( padded_dest, padded_ones, radial, left, top, splat_x-left, splat_y-top, flatten );
-					Splat( padded_dest, padded_ones, radial, right, top, splat_x-right, splat_y-top, flatten );
-				}
-				else if( left == right ) 
+				grid[2*i] += radial[2*i] * kern_value;
+				grid[2*i+1] += radial[2*i+1] * kern_value;
+			}
+
+			if( any_own_weights )
+			{
+				int view = sample / columns;
+				float* weights = &tile_weights[local * num_images];
+				for( int i = 0; i < num_images; i++ )
+					if( own_weights[i] && use_view[view*num_images + i] )
+						weights[i] += kern_value;
+			}
+		}
+
+		// get rid of padding and flatten
+		for( int y = first_y; y < std::min( first_y + tile_size, dest_size ); y++ )
+		for( int x = first_x; x < std::min( first_x + tile_size, dest_size ); x++ )
+		{
+			int local = ( y - first_y ) * tile_size + x - first_x;
+			int dest_index = y*dest_size + x;
+			float density = plan.density[y*grid_size + x];
+			const float* grid = &tile_grid[2 * local * num_images];
+			for( int i = 0; i < num_images; i++ )
+			{
+				float* dest_image = (*args->dest_images)[i];
+				float ones_value = 0;
+				if( args->flatten )
+					ones_value = ( own_weights[i] )? tile_weights[local*num_images + i]: density;
+				if( ones_value > 1e-20 )
 				{
-					Splat( padded_dest, padded_ones, radial, left, top, splat_x-left, splat_y-top, flatten );
-					Splat( padded_dest, padded_ones, radial, left, bottom, splat_x-left, splat_y-bottom, flatten);
+					dest_image[2*dest_index] = grid[2*i] / ones_value;
+					dest_image[2*dest_index+1] = grid[2*i+1] / ones_value;
 				}
 				else
 				{
-					Splat( padded_dest, padded_ones, radial, left, top, splat_x-left, splat_y-top, flatten);
-					Splat( padded_dest, padded_ones, radial, right, top, splat_x-right, splat_y-top, flatten);
-					Splat( padded_dest, padded_ones, radial, left, bottom, splat_x-left, splat_y-bottom, flatten);
-					Splat( padded_dest, padded_ones, radial, right, bottom, splat_x-right, splat_y-bottom, flatten);
+					dest_image[2*dest_index] = grid[2*i];
+					dest_image[2*dest_index+1] = grid[2*i+1];
 				}
 			}
 		}
+	}
+
+	return 0;
+}
 
-		// get rid of padding
-		for( int x = 0; x < cart_data.Size().Column; x++ )
-		for( int y = 0; y < cart_data.Size().Line; y++ )
+double RadialGridder::GetViewAngle( int view, int phase, int repetition, const MRIDimensions& size ) const
+{
+	double theta = 0;
+
+	if( view_ordering == VO_JORDAN_JITTER )
+	{
+		int phases = size.Phase;
+		int radial_views = size.Line;
+
+		int center_phase = (int)ceil( phases / 2 ) ;
+		int phase_order;
+		if( phase % 2 == 0 )
+			phase_order = (int)ceil(phase/2);
+		else
+			phase_order = (int)ceil((phase-1)/2) + center_phase;
+
+		double jitter_theta = M_PI / ( radial_views * phases );
+		double delta_theta= (double)(M_PI / radial_views );
+
+		double theta_offset = jitter_theta * phase_order;
+		theta = view * delta_theta + theta_offset;
+	}
+	else if( view_ordering == VO_GOLDEN_RATIO )
+	{
+		double golden_angle = M_PI * ( ( sqrt( 5 ) - 1 ) / 2 );
+		//int view_index = (repetition+repetition_offset)*size.Line+ view;
+		int view_index = (repetition+phase)*size.Line+ view;
+		theta = view_index*golden_angle;
+		theta = fmod( theta, M_PI );
+	}
+	else if( view_ordering == VO_GOLDEN_RATIO_NO_PHASE )
+	{
+		double golden_angle = M_PI * ( ( sqrt( 5 ) - 1 ) / 2 );
+		int view_index = view;
+		theta = view_index*golden_angle;
+		theta = fmod( theta, M_PI );
+	}
+
+	return theta;
+}
+
+void* RadialGridder::DegridThread( void* degrid_args )
+{
+	DegridArgs* args = (DegridArgs*)degrid_args;
+	InterpImage( *args->plan, args->grid, args->radial_image, args->first_view, args->last_view );
+	return 0;
+}
+
+void RadialGridder::InterpImage( const TrajectoryPlan& plan, const float* grid, float* radial_image, int first_view, int last_view )
+{
+	int columns = plan.columns;
+	const int* tap_index = &plan.tap_index[0];
+	const float* tap_weight = &plan.tap_weight[0];
+
+	for( int sample = first_view*columns; sample < last_view*columns; sample++ )
+	{
+		float real = 0;
+		float imag = 0;
+		for( int tap = plan.sample_taps[sample]; tap < plan.sample_taps[sample+1]; tap++ )
 		{
-			float ones_value = ( flatten )? padded_ones.GetDataIndex( x, y, 0, 0, 0, 0, 0, 0, 0, 0, 0 )[0]: 0;
-			// flatten
-			if( ones_value > 1e-20 )
-			{
-				cart_data.GetDataIndex( x, y, channel, set, phase, slice, echo, repetition, partition, segment, average )[0] = padded_dest.GetDataIndex( x, y, 0, 0, 0, 0, 0, 0, 0, 0, 0 )[0] / ones_value;
-				if( cart_data.IsComplex() )
-					cart_data.GetDataIndex( x, y, channel, set, phase, slice, echo, repetition, partition, segment, average )[1] = padded_dest.GetDataIndex( x, y, 0, 0, 0, 0, 0, 0, 0, 0, 0 )[1] / ones_value;
-			}
-			// don't flatten
-			else
-			{
-				cart_data.GetDataIndex( x, y, channel, set, phase, slice, echo, repetition, partition, segment, average )[0] = padded_dest.GetDataIndex( x, y, 0, 0, 0, 0, 0, 0, 0, 0, 0 )[0];
-				if( cart_data.IsComplex() )
-					cart_data.GetDataIndex( x, y, channel, set, phase, slice, echo, repetition, partition, segment, average )[1] = padded_dest.GetDataIndex( x, y, 0, 0, 0, 0, 0, 0, 0, 0, 0 )[1];
-			}
+			const float* grid_value = grid + 2*tap_index[tap];
+			real += grid_value[0] * tap_weight[tap];
+			imag += grid_value[1] * tap_weight[tap];
+		}
+		radial_image[2*sample] = real;
+		radial_image[2*sample+1] = imag;
+	}
+}
+
+void RadialGridder::GetApodization( int columns, int grid_size, std::vector<double>& apodization ) const
+{
+	// the kernel's transform along one axis, scaled like a native resolution bilinear grid
+	int offset = grid_size / 2 - columns / 2;
+	apodization.resize( columns );
+	for( int i = 0; i < columns; i++ )
+	{
+		double frequency = ( i + offset - grid_size / 2 ) / (double)grid_size;
+		double sum = kernel_lut[0];
+		for( int j = 1; j < (int)kernel_lut.size() && j < kernel_radius * lut_scale; j++ )
+			sum += 2 * kernel_lut[j] * cos( 2 * M_PI * frequency * j / lut_scale );
+		apodization[i] = sum * columns / ( grid_size * lut_scale );
+	}
+}
+
+void RadialGridder::Apodize( const MRIData& cart_data, MRIData& oversampled_data )
+{
+	int grid_size = oversampled_data.Size().Column;
+	int columns = cart_data.Size().Column;
+	int offset = grid_size / 2 - columns / 2;
+
+	// to centered image space
+	MRIData image_data( cart_data );
+	FilterTool::FFTShift( image_data, true );
+	FilterTool::FFT2D( image_data, true );
+	FilterTool::FFTShift( image_data );
+
+	// apodize and zero pad the field of view, the scale makes this the adjoint of Deapodize
+	std::vector<double> apodization;
+	GetApodization( columns, grid_size, apodization );
+	double adjoint_scale = ( (double)columns * columns ) / ( (double)grid_size * grid_size );
+	oversampled_data.SetAll( 0 );
+	int num_images = cart_data.NumPixels() / ( columns * columns );
+	for( int image = 0; image < num_images; image++ )
+	{
+		float* source = image_data.GetDataStart() + 2L * image * columns * columns;
+		float* dest = oversampled_data.GetDataStart() + 2L * image * grid_size * grid_size;
+		for( int y = 0; y < columns; y++ )
+		for( int x = 0; x < columns; x++ )
+		{
+			float* dest_pixel = dest + 2 * ( ( y + offset ) * grid_size + x + offset );
+			float scale = (float)( adjoint_scale / ( apodization[y] * apodization[x] ) );
+			dest_pixel[0] = source[2*(y*columns + x)] * scale;
+			dest_pixel[1] = source[2*(y*columns + x) + 1] * scale;
 		}
 	}
 
-	return true;
+	// to centered oversampled k-space
+	FilterTool::FFTShift( oversampled_data, true );
+	FilterTool::FFT2D( oversampled_data );
+	FilterTool::FFTShift( oversampled_data );
 }
 
-bool RadialGridder::Initialize( InterpKernelType interp_kernel_type, int kernel_size )
+void RadialGridder::Deapodize( MRIData& oversampled_data, MRIData& cart_data, bool flatten )
 {
-	// kernel_size must be odd
-	if( kernel_size % 2 == 0 )
+	int grid_size = oversampled_data.Size().Column;
+	int columns = cart_data.Size().Column;
+	int offset = grid_size / 2 - columns / 2;
+
+	// to centered image space
+	FilterTool::FFTShift( oversampled_data, true );
+	FilterTool::FFT2D( oversampled_data, true );
+	FilterTool::FFTShift( oversampled_data );
+
+	// flattened grids are already normalized by the kernel weights and only need resampling
+	std::vector<double> apodization( columns, 1.0 );
+	if( !flatten )
+		GetApodization( columns, grid_size, apodization );
+
+	// crop the field of view and deapodize
+	int num_images = cart_data.NumPixels() / ( columns * columns );
+	for( int image = 0; image < num_images; image++ )
 	{
-		GIRLogger::LogError( "RadialGridder::Initialize -> kernel_size must be odd, changed from %d to %d...\n", kernel_size, kernel_size+1 );
-		kernel_size++;
+		float* source = oversampled_data.GetDataStart() + 2L * image * grid_size * grid_size;
+		float* dest = cart_data.GetDataStart() + 2L * image * columns * columns;
+		for( int y = 0; y < columns; y++ )
+		for( int x = 0; x < columns; x++ )
+		{
+			float* source_pixel = source + 2 * ( ( y + offset ) * grid_size + x + offset );
+			float scale = (float)( 1.0 / ( apodization[y] * apodization[x] ) );
+			dest[2*(y*columns + x)] = source_pixel[0] * scale;
+			dest[2*(y*columns + x) + 1] = source_pixel[1] * scale;
+		}
 	}
 
+	// back to centered k-space
+	FilterTool::FFTShift( cart_data, true );
+	FilterTool::FFT2D( cart_data );
+	FilterTool::FFTShift( cart_data );
+}
+
+bool RadialGridder::Initialize( InterpKernelType interp_kernel_type, int kernel_size )
+{
 	// load kernel
 	switch( interp_kernel_type )
 	{
 		case KERN_TYPE_BILINEAR:
+			// kernel_size must be odd
+			if( kernel_size % 2 == 0 )
+			{
+				GIRLogger::LogError( "RadialGridder::Initialize -> kernel_size must be odd, changed from %d to %d...\n", kernel_size, kernel_size+1 );
+				kernel_size++;
+			}
 			LoadBilinearKernel( kernel_size );
 			break;
+		case KERN_TYPE_KAISER_BESSEL:
+			LoadKaiserBesselKernel();
+			break;
 		default:
 			GIRLogger::LogError( "RadialGridder::Initialize -> attempted to use un-implemented interpolation kernel type!" );
 			return false;
@@ -197,42 +1022,40 @@ bool RadialGridder::Initialize( InterpKernelType interp_kernel_type, int kernel_
 
 void RadialGridder::LoadBilinearKernel( int kernel_size )
 {
-	// initialize kernel object
-	kernel = MRIData( MRIDimensions( kernel_size, kernel_size, 1, 1, 1, 1, 1, 1, 1, 1, 1 ), false );
-	kernel_center = (int)floor( kernel_size / 2 );
-	float* kernel_data = kernel.GetDataStart();
-
-	// fill kernel
-	for( int x = 0; x < kernel_size; x++ ) 
-	{
-		float ramp_x  = ( x < kernel_center )? (float)x / kernel_center : 1 - ( (float)(x - kernel_center ) / ( kernel_center ) );
-		for( int y = 0; y < kernel_size; y++ ) 
-		{
-			float ramp_y  = ( y < kernel_center )? (float)y / kernel_center : 1 - ( (float)(y - kernel_center ) / ( kernel_center ) );
-			kernel_data[x*kernel_size + y] = ramp_x * ramp_y;
-		}
-	}
+	// one side of a kernel_size ramp, which is what the old 2D kernel table was the outer product of,
+	// always one original grid point wide so oversampled grids don't end up with holes
+	int kernel_center = (int)floor( kernel_size / 2 );
+	kernel_radius = oversampling;
+	lut_scale = kernel_size / 2.0f / oversampling;
+	kernel_lut.resize( kernel_center + 1 );
+	for( int i = 0; i <= kernel_center; i++ )
+		kernel_lut[i] = 1 - ( (float)i / kernel_center );
 }
 
-void RadialGridder::Splat( MRIData& cartesian, MRIData& weights, float* radial_value, int cart_x, int cart_y, double splat_diff_x, double splat_diff_y, bool flatten )
+void RadialGridder::LoadKaiserBesselKernel()
 {
-	// find cartesian value
-	float* cartesian_value = cartesian.GetDataIndex( cart_x, cart_y, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+	if( kernel_width < 1 )
+	{
+		GIRLogger::LogError( "RadialGridder::LoadKaiserBesselKernel -> kernel_width must be at least 1, changed from %f to 1...\n", kernel_width );
+		kernel_width = 1;
+	}
 
-	// find kernel value
-	int kern_x = (int)round( splat_diff_y * kernel.Size().Column / 2) + kernel_center; 
-	int kern_y = (int)round( splat_diff_x * kernel.Size().Column / 2) + kernel_center;
-	float* kern_value = kernel.GetDataIndex( kern_x, kern_y, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
+	// beta from Beatty et al., IEEE TMI 2005, minimizes aliasing for the given width and oversampling
+	double width_ratio = kernel_width / oversampling;
+	double beta_squared = width_ratio * width_ratio * ( oversampling - 0.5 ) * ( oversampling - 0.5 ) - 0.8;
+	double beta = ( beta_squared > 0 )? M_PI * sqrt( beta_squared ): 0;
 
-	// splat to cartesian 
-	cartesian_value[0] += radial_value[0] * kern_value[0];
-	if( cartesian.IsComplex() )
-		cartesian_value[1] += radial_value[1] * kern_value[0];
+	kernel_radius = kernel_width / 2;
+	lut_scale = KB_LUT_SAMPLES;
+	int lut_size = (int)( kernel_radius * lut_scale ) + 2;
+	kernel_lut.resize( lut_size );
 
-	// splat to ones
-	if( flatten )
+	double i0_beta = BesselI0( beta );
+	for( int i = 0; i < lut_size; i++ )
 	{
-		float* weights_value = weights.GetDataIndex( cart_x, cart_y, 0, 0, 0, 0, 0, 0, 0, 0, 0 );
-		weights_value[0] += kern_value[0];
+		double u = i / ( lut_scale * kernel_radius );
+		kernel_lut[i] = ( u < 1 )? (float)( BesselI0( beta * sqrt( 1 - u*u ) ) / i0_beta ): 0;
 	}
+
+	GIRLogger::LogDebug( "### Kaiser-Bessel kernel: width %f, oversampling %f, beta %f...\n", kernel_width, oversampling, beta );
 }
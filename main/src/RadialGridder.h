@@ -2,31 +2,106 @@
 #define __RADIAL_GRIDDER_H__
 
 #include <MRIData.h>
+#include <vector>
+#include <list>
 
+// sample to grid mapping of one radial trajectory, shared by every image acquired along it
+class TrajectoryPlan
+{
+	public:
+	TrajectoryPlan(): columns( 0 ), grid_size( 0 ), grid_center( 0 ), grid_scale( 0 ), wrap( false ), kernel_radius( 0 ), lut_scale( 0 ), tile_size( 0 ), tiles_per_row( 0 ) {}
+
+	// what the plan was built for
+	int columns;
+	std::vector<double> angles;
+	int grid_size;
+	double grid_center;
+	double grid_scale;
+	bool wrap;
+	float kernel_radius;
+	float lut_scale;
+	std::vector<float> kernel_lut;
+
+	// taps of sample view*columns + ro_sample are [sample_taps[sample], sample_taps[sample+1])
+	std::vector<int> sample_taps;
+	std::vector<int> tap_index;
+	std::vector<float> tap_weight;
+
+	// kernel weights splatted from every sample, what flattened grids are divided by
+	std::vector<float> density;
+
+	// the same taps binned by the tile_size x tile_size grid tile they land in, tile t's are [tile_taps[t], tile_taps[t+1]),
+	// still in sample order within a tile so every grid point adds up its samples in the same order either way
+	int tile_size;
+	int tiles_per_row;
+	std::vector<int> tile_taps;
+	std::vector<int> binned_sample;
+	std::vector<int> binned_index;
+	std::vector<float> binned_weight;
+
+	int Views() const { return angles.size(); }
+	long Bytes() const;
+};
 
 class RadialGridder
 {
 	public:
-	enum InterpKernelType { KERN_TYPE_BILINEAR };
+	enum InterpKernelType { KERN_TYPE_BILINEAR, KERN_TYPE_KAISER_BESSEL };
 	enum ViewOrderingType { VO_NONE, VO_JORDAN_JITTER, VO_GOLDEN_RATIO, VO_GOLDEN_RATIO_NO_PHASE };
 
-	RadialGridder(): repetition_offset( 0 ), view_ordering( VO_NONE ), kernel_center( -1 ) {}
+	RadialGridder(): repetition_offset( 0 ), view_ordering( VO_NONE ), oversampling( 1 ), kernel_width( 4 ), kernel_radius( 0 ), lut_scale( 0 ) {}
 	~RadialGridder();
 
 	int repetition_offset;
 	ViewOrderingType view_ordering;
 
+	// grid oversampling ratio, anything above 1 grids onto a finer grid and deapodizes back to Column x Column
+	float oversampling;
+	// width of the Kaiser-Bessel kernel in oversampled grid points
+	float kernel_width;
+
 	bool Grid( const MRIData& radial_data, MRIData& cart_data, InterpKernelType kernel_type, int kernel_size, bool flatten );
+	// grids a window of window_views consecutive views sliding view_step views at a time along the views of every phase in the
+	// order they were acquired (line by line, repetition by repetition), the frames end up along Repetition of cart_data;
+	// every frame only adds the views entering the window and takes out the ones leaving it
+	bool GridSlidingWindow( const MRIData& radial_data, MRIData& cart_data, InterpKernelType kernel_type, int kernel_size, int window_views, int view_step, bool flatten );
+	// interpolates Column x Column cart_data back onto the radial samples, radial_data has to be allocated already and
+	// its Line is the number of views, this is the adjoint of Grid without flatten
+	bool Degrid( const MRIData& cart_data, MRIData& radial_data, InterpKernelType kernel_type, int kernel_size );
+	// spectra of the point spread functions of the trajectories of radial_size on a 2*Column grid, one per phase and repetition, with zero
+	// frequency in the corner; for an image with its origin in the corner (FFTShift'd around Degrid and Grid), FFT2D( image ) -> Degrid ->
+	// Grid -> FFT2D( reverse ) is then FFT2D( FFT2D( padded ) * kernel_data, reverse ), padded being the image zero padded to 2*Column
+	// with its quadrants moved out to the corners, and the result cut back out the same way
+	bool GetToeplitzKernel( const MRIDimensions& radial_size, MRIData& kernel_data, InterpKernelType kernel_type, int kernel_size );
 
 
 	private:
-	int kernel_center;
-	MRIData kernel;
+	// most recently used plans are at the back
+	std::list<TrajectoryPlan> plans;
+
+	// kernel weight for a distance d (in grid points) is kernel_lut[(int)( |d| * lut_scale + 0.5 )] while |d| < kernel_radius
+	float kernel_radius;
+	float lut_scale;
+	std::vector<float> kernel_lut;
 
 	bool Initialize( InterpKernelType interp_kernel_type, int kernel_size );
 	void LoadBilinearKernel( int kernel_size );
-	void Splat( MRIData& cartesian, MRIData& weights, float* radial_value, int cart_x, int cart_y, double splat_diff_x, double splat_diff_y, bool flatten );
-
+	void LoadKaiserBesselKernel();
+	bool SetUpGrid( int columns, InterpKernelType kernel_type, int kernel_size, int& grid_size, double& grid_center, double& grid_scale, bool& deapodize );
+	double GetViewAngle( int view, int phase, int repetition, const MRIDimensions& size ) const;
+	void GroupImages( const MRIDimensions& size, std::vector< std::vector<double> >& group_angles, std::vector< std::vector<int> >& group_images ) const;
+	const TrajectoryPlan* GetPlan( const std::vector<double>& angles, int columns, int grid_size, double grid_center, double grid_scale, bool wrap );
+	static void BuildPlan( TrajectoryPlan& plan );
+	static void BinPlan( TrajectoryPlan& plan );
+	static void* GridThread( void* grid_args );
+	// adds ( sign 1 ) or takes out ( sign -1 ) one view
+	static void AccumulateView( const TrajectoryPlan& plan, int view, const float* radial_view, double sign, double* grid, double* weights );
+	static void* SlidingWindowThread( void* window_args );
+	static void InterpImage( const TrajectoryPlan& plan, const float* grid, float* radial_image, int first_view, int last_view );
+	static void* DegridThread( void* degrid_args );
+	void GetApodization( int columns, int grid_size, std::vector<double>& apodization ) const;
+	void Apodize( const MRIData& cart_data, MRIData& oversampled_data );
+	void Deapodize( MRIData& oversampled_data, MRIData& cart_data, bool flatten );
 };
 
 #endif
@@ -0,0 +1,287 @@
+#include <ThreadPool.h>
+#include <GIRLogger.h>
+#include <unistd.h>
+#include <sched.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <cmath>
+#include <sstream>
+#include <algorithm>
+
+ThreadPool* ThreadPool::instance = 0;
+pthread_mutex_t ThreadPool::instance_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// cpu.max of cgroup v2 or cfs quota / period of cgroup v1, 0 if there's no limit
+static double CPUQuota()
+{
+	double quota = 0;
+	double period = 0;
+	FILE* file = fopen( "/sys/fs/cgroup/cpu.max", "r" );
+	if( file != 0 )
+	{
+		char quota_string[32];
+		if( fscanf( file, "%31s %lf", quota_string, &period ) == 2 && strcmp( quota_string, "max" ) != 0 )
+			quota = atof( quota_string );
+		fclose( file );
+	}
+	else if( ( file = fopen( "/sys/fs/cgroup/cpu/cpu.cfs_quota_us", "r" ) ) != 0 )
+	{
+		if( fscanf( file, "%lf", &quota ) != 1 )
+			quota = 0;
+		fclose( file );
+		if( ( file = fopen( "/sys/fs/cgroup/cpu/cpu.cfs_period_us", "r" ) ) != 0 )
+		{
+			if( fscanf( file, "%lf", &period ) != 1 )
+				period = 0;
+			fclose( file );
+		}
+	}
+	return ( quota > 0 && period > 0 )? quota / period: 0;
+}
+
+int ThreadPool::AvailableProcessors()
+{
+	int processors = sysconf( _SC_NPROCESSORS_ONLN );
+
+	cpu_set_t allowed;
+	CPU_ZERO( &allowed );
+	if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) == 0 && CPU_COUNT( &allowed ) > 0 )
+		processors = std::min( processors, (int)CPU_COUNT( &allowed ) );
+
+	// a fractional quota still gets the partially usable processor
+	double quota = CPUQuota();
+	if( quota > 0 )
+		processors = std::min( processors, (int)ceil( quota ) );
+
+	return std::max( processors, 1 );
+}
+
+ThreadPool::ThreadPool( int new_num_threads ): pinned( false ), current_job( 0 ), current_args( 0 ), next_job( 0 ), static_schedule( false ), jobs_left( 0 ), shutdown( false )
+{
+	if( new_num_threads < 1 )
+		new_num_threads = AvailableProcessors();
+	if( new_num_threads < 1 )
+		new_num_threads = 1;
+
+	pthread_mutex_init( &run_mutex, NULL );
+	pthread_mutex_init( &job_mutex, NULL );
+	pthread_cond_init( &job_cond, NULL );
+	pthread_cond_init( &done_cond, NULL );
+
+	threads.resize( new_num_threads );
+	worker_starts.resize( new_num_threads );
+	worker_next.resize( new_num_threads );
+	for( int i = 0; i < new_num_threads; i++ )
+	{
+		worker_starts[i].pool = this;
+		worker_starts[i].index = i;
+		if( pthread_create( &threads[i], NULL, Worker, (void*)&worker_starts[i] ) != 0 )
+		{
+			GIRLogger::LogError( "ThreadPool::ThreadPool -> unable to create thread %d, continuing with %d threads...\n", i, i );
+			threads.resize( i );
+			break;
+		}
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	pthread_mutex_lock( &job_mutex );
+	shutdown = true;
+	pthread_cond_broadcast( &job_cond );
+	pthread_mutex_unlock( &job_mutex );
+
+	for( int i = 0; i < (int)threads.size(); i++ )
+		pthread_join( threads[i], NULL );
+
+	pthread_cond_destroy( &done_cond );
+	pthread_cond_destroy( &job_cond );
+	pthread_mutex_destroy( &job_mutex );
+	pthread_mutex_destroy( &run_mutex );
+}
+
+void ThreadPool::RunJobs( void* (*job)( void* ), const std::vector<void*>& job_args, bool new_static_schedule )
+{
+	int num_jobs = job_args.size();
+
+	// nested runs would wait on themselves, and a single job isn't worth the hand-off
+	if( num_jobs == 1 || threads.size() == 0 || IsWorker() )
+	{
+		for( int i = 0; i < num_jobs; i++ )
+			job( job_args[i] );
+		return;
+	}
+	if( num_jobs == 0 )
+		return;
+
+	// one batch at a time
+	pthread_mutex_lock( &run_mutex );
+	pthread_mutex_lock( &job_mutex );
+	current_job = job;
+	current_args = &job_args;
+	next_job = 0;
+	static_schedule = new_static_schedule;
+	for( int i = 0; i < (int)threads.size(); i++ )
+		worker_next[i] = i;
+	jobs_left = num_jobs;
+	pthread_cond_broadcast( &job_cond );
+	while( jobs_left > 0 )
+		pthread_cond_wait( &done_cond, &job_mutex );
+	current_job = 0;
+	current_args = 0;
+	pthread_mutex_unlock( &job_mutex );
+	pthread_mutex_unlock( &run_mutex );
+}
+
+bool ThreadPool::IsWorker() const
+{
+	pthread_t self = pthread_self();
+	for( int i = 0; i < (int)threads.size(); i++ )
+		if( pthread_equal( self, threads[i] ) )
+			return true;
+	return false;
+}
+
+bool ThreadPool::HasJob( int worker ) const
+{
+	if( current_args == 0 )
+		return false;
+	int job_index = ( static_schedule )? worker_next[worker]: next_job;
+	return job_index < (int)current_args->size();
+}
+
+void* ThreadPool::Worker( void* start )
+{
+	ThreadPool* thread_pool = ( (WorkerStart*)start )->pool;
+	int index = ( (WorkerStart*)start )->index;
+
+	pthread_mutex_lock( &thread_pool->job_mutex );
+	while( true )
+	{
+		while( !thread_pool->shutdown && !thread_pool->HasJob( index ) )
+			pthread_cond_wait( &thread_pool->job_cond, &thread_pool->job_mutex );
+		if( thread_pool->shutdown )
+			break;
+
+		int job_index = 0;
+		if( thread_pool->static_schedule )
+		{
+			job_index = thread_pool->worker_next[index];
+			thread_pool->worker_next[index] += thread_pool->threads.size();
+		}
+		else
+			job_index = thread_pool->next_job++;
+		void* (*job)( void* ) = thread_pool->current_job;
+		void* job_args = (*thread_pool->current_args)[job_index];
+
+		pthread_mutex_unlock( &thread_pool->job_mutex );
+		job( job_args );
+		pthread_mutex_lock( &thread_pool->job_mutex );
+
+		if( --thread_pool->jobs_left == 0 )
+			pthread_cond_signal( &thread_pool->done_cond );
+	}
+	pthread_mutex_unlock( &thread_pool->job_mutex );
+
+	return 0;
+}
+
+// node directory linked under the processor's sysfs entry, -1 without one
+static int ProcessorNode( int cpu )
+{
+	char path[64];
+	snprintf( path, sizeof( path ), "/sys/devices/system/cpu/cpu%d", cpu );
+	DIR* dir = opendir( path );
+	if( dir == 0 )
+		return -1;
+
+	int node = -1;
+	dirent* entry;
+	while( ( entry = readdir( dir ) ) != 0 )
+	{
+		if( strncmp( entry->d_name, "node", 4 ) == 0 && sscanf( entry->d_name + 4, "%d", &node ) == 1 )
+			break;
+		node = -1;
+	}
+	closedir( dir );
+	return node;
+}
+
+bool ThreadPool::PinThreads()
+{
+	pthread_mutex_lock( &run_mutex );
+	if( pinned )
+	{
+		pthread_mutex_unlock( &run_mutex );
+		return true;
+	}
+
+	cpu_set_t allowed;
+	CPU_ZERO( &allowed );
+	if( sched_getaffinity( 0, sizeof( allowed ), &allowed ) != 0 || CPU_COUNT( &allowed ) == 0 )
+	{
+		GIRLogger::LogError( "ThreadPool::PinThreads -> unable to read the process affinity, threads stay unpinned!\n" );
+		pthread_mutex_unlock( &run_mutex );
+		return false;
+	}
+	std::vector<int> cpus;
+	for( int cpu = 0; cpu < CPU_SETSIZE; cpu++ )
+		if( CPU_ISSET( cpu, &allowed ) )
+			cpus.push_back( cpu );
+
+	bool success = true;
+	std::stringstream placement;
+	worker_nodes.assign( threads.size(), -1 );
+	for( int i = 0; i < (int)threads.size(); i++ )
+	{
+		int cpu = cpus[i % cpus.size()];
+		cpu_set_t target;
+		CPU_ZERO( &target );
+		CPU_SET( cpu, &target );
+		if( pthread_setaffinity_np( threads[i], sizeof( target ), &target ) != 0 )
+		{
+			GIRLogger::LogError( "ThreadPool::PinThreads -> unable to pin worker %d to cpu %d!\n", i, cpu );
+			success = false;
+			continue;
+		}
+		worker_nodes[i] = ProcessorNode( cpu );
+		placement << " " << i << ":" << cpu << "/" << worker_nodes[i];
+	}
+	GIRLogger::LogInfo( "ThreadPool::PinThreads -> worker:cpu/node%s\n", placement.str().c_str() );
+
+	pinned = success;
+	pthread_mutex_unlock( &run_mutex );
+	return success;
+}
+
+int ThreadPool::WorkerNode( int worker ) const
+{
+	if( !pinned || worker < 0 || worker >= (int)worker_nodes.size() )
+		return -1;
+	return worker_nodes[worker];
+}
+
+ThreadPool* ThreadPool::Instance()
+{
+	pthread_mutex_lock( &instance_mutex );
+	if( instance == 0 )
+	{
+		instance = new ThreadPool();
+		GIRLogger::LogInfo( "ThreadPool::Instance -> started %d threads for %d online processors...\n", instance->NumThreads(), (int)sysconf( _SC_NPROCESSORS_ONLN ) );
+	}
+	pthread_mutex_unlock( &instance_mutex );
+	return instance;
+}
+
+void ThreadPool::DestroyInstance()
+{
+	pthread_mutex_lock( &instance_mutex );
+	if( instance != 0 )
+	{
+		delete instance;
+		instance = 0;
+	}
+	pthread_mutex_unlock( &instance_mutex );
+}
@@ -0,0 +1,84 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <pthread.h>
+#include <vector>
+
+// persistent worker threads that run a batch of jobs and wait for all of them to finish
+class ThreadPool
+{
+	public:
+	// new_num_threads < 1 uses one thread per available processor
+	ThreadPool( int new_num_threads = 0 );
+	~ThreadPool();
+
+	int NumThreads() const { return threads.size(); }
+
+	// calls job( &args[i] ) for every i, jobs are handed out to the workers in order as they free up,
+	// runs serially on the calling thread when called from one of the pool's own workers
+	template <class T> void Run( void* (*job)( void* ), std::vector<T>& args )
+	{
+		std::vector<void*> job_args( args.size() );
+		for( int i = 0; i < (int)args.size(); i++ )
+			job_args[i] = (void*)&args[i];
+		RunJobs( job, job_args );
+	}
+	// like Run, but job i always goes to worker i % NumThreads(), so memory a job first touches stays next to the
+	// jobs with the same index in later batches
+	template <class T> void RunStatic( void* (*job)( void* ), std::vector<T>& args )
+	{
+		std::vector<void*> job_args( args.size() );
+		for( int i = 0; i < (int)args.size(); i++ )
+			job_args[i] = (void*)&args[i];
+		RunJobs( job, job_args, true );
+	}
+	void RunJobs( void* (*job)( void* ), const std::vector<void*>& job_args, bool static_schedule = false );
+
+	// pins worker i to the i-th processor the process may run on and logs the placement, returns false if the
+	// affinity couldn't be set
+	bool PinThreads();
+	bool IsPinned() const { return pinned; }
+	// NUMA node of the processor worker is pinned to, -1 if not pinned or unknown
+	int WorkerNode( int worker ) const;
+
+	// online processors the process may run on, limited by the cgroup cpu quota
+	static int AvailableProcessors();
+
+	// pool shared by the native reconstruction code
+	static ThreadPool* Instance();
+	static void DestroyInstance();
+
+	private:
+	static ThreadPool* instance;
+	static pthread_mutex_t instance_mutex;
+
+	struct WorkerStart
+	{
+		ThreadPool* pool;
+		int index;
+	};
+
+	std::vector<pthread_t> threads;
+	std::vector<WorkerStart> worker_starts;
+	std::vector<int> worker_nodes;
+	bool pinned;
+	pthread_mutex_t run_mutex;
+	pthread_mutex_t job_mutex;
+	pthread_cond_t job_cond;
+	pthread_cond_t done_cond;
+
+	void* (*current_job)( void* );
+	const std::vector<void*>* current_args;
+	int next_job;
+	bool static_schedule;
+	// next job of every worker in a static batch
+	std::vector<int> worker_next;
+	int jobs_left;
+	bool shutdown;
+
+	bool IsWorker() const;
+	bool HasJob( int worker ) const;
+	static void* Worker( void* start );
+};
+
+#endif
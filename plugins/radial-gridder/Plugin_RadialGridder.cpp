@@ -39,6 +39,35 @@ bool Plugin_RadialGridder::Configure( GIRConfig& config, bool main_config, bool
 	// get flatten
 	config.GetParam( plugin_id.c_str(), alias.c_str(), "flatten", flatten );
 
+	// get kernel param
+	std::string kernel_string = "BILINEAR";
+	if( config.GetParam( plugin_id.c_str(), alias.c_str(), "kernel", kernel_string ) )
+	{
+		if( kernel_string.compare( "BILINEAR" ) == 0 )
+			kernel_type = RadialGridder::KERN_TYPE_BILINEAR;
+		else if( kernel_string.compare( "KAISER_BESSEL" ) == 0 )
+			kernel_type = RadialGridder::KERN_TYPE_KAISER_BESSEL;
+		else
+		{
+			GIRLogger::LogError( "Plugin_RadialGridder::Configure -> invalid kernel: '%s'!\n", kernel_string.c_str() );
+			return false;
+		}
+	}
+
+	// get kernel_size, oversampling and kernel_width
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "kernel_size", kernel_size );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "oversampling", oversampling );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "kernel_width", kernel_width );
+
+	// get sliding window
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "window_views", window_views );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "view_step", view_step );
+	if( window_views > 0 && view_step < 1 )
+	{
+		GIRLogger::LogError( "Plugin_RadialGridder::Configure -> view_step cannot be less than 1 as specified!\n" );
+		return false;
+	}
+
 	return true;
 }
 
@@ -47,12 +76,25 @@ bool Plugin_RadialGridder::Reconstruct( MRIData& mri_data )
 	MRIData gridded;
 	RadialGridder gridder;
 	gridder.view_ordering = view_ordering;
+	gridder.oversampling = oversampling;
+	gridder.kernel_width = kernel_width;
 
 	GIRLogger::LogInfo( "Plugin_RadialGridder::Reconstruct -> gridding...\n" );
 	if( !flatten )
 		GIRLogger::LogInfo( "Plugin_RadialGridder::Reconstruct -> not flattening...\n" );
+	if( kernel_type == RadialGridder::KERN_TYPE_KAISER_BESSEL )
+		GIRLogger::LogInfo( "Plugin_RadialGridder::Reconstruct -> Kaiser-Bessel kernel, width: %f, oversampling: %f...\n", kernel_width, oversampling );
+
+	bool success;
+	if( window_views > 0 )
+	{
+		GIRLogger::LogInfo( "Plugin_RadialGridder::Reconstruct -> sliding window of %d views, step: %d...\n", window_views, view_step );
+		success = gridder.GridSlidingWindow( mri_data, gridded, kernel_type, kernel_size, window_views, view_step, flatten );
+	}
+	else
+		success = gridder.Grid( mri_data, gridded, kernel_type, kernel_size, flatten );
 
-	if( gridder.Grid( mri_data, gridded, RadialGridder::KERN_TYPE_BILINEAR, 101, flatten) )
+	if( success )
 	{
 		mri_data = gridded;
 		return true;
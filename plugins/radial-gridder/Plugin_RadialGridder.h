@@ -10,11 +10,18 @@ class GIRConfig;
 class Plugin_RadialGridder: public ReconPlugin
 {
 	public:
-	Plugin_RadialGridder( const char* new_plugin_id, const char* new_alias ): ReconPlugin( new_plugin_id, new_alias ), flatten( true ) {}
+	Plugin_RadialGridder( const char* new_plugin_id, const char* new_alias ): ReconPlugin( new_plugin_id, new_alias ), view_ordering( RadialGridder::VO_NONE ), flatten( true ), kernel_type( RadialGridder::KERN_TYPE_BILINEAR ), kernel_size( 101 ), oversampling( 1 ), kernel_width( 4 ), window_views( 0 ), view_step( 1 ) {}
 
 	protected:
 	RadialGridder::ViewOrderingType view_ordering;
 	bool flatten;
+	RadialGridder::InterpKernelType kernel_type;
+	int kernel_size;
+	float oversampling;
+	float kernel_width;
+	// window_views > 0 grids a sliding window over the views instead of every repetition on its own
+	int window_views;
+	int view_step;
 
 	bool Configure( GIRConfig& config, bool main_config, bool final_config );
 	bool Reconstruct( MRIData& mri_data );
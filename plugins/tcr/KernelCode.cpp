@@ -1,12 +1,17 @@
 #include <KernelCode.h>
 #include <FilterTool.h>
 #include <cmath>
+#include <string.h>
 
 #ifdef TCR_KERNEL_CUDA
 	#include <cufft.h>
 #else
-	void* CPU_ApplySensitivityDirection( void* args_ptr, bool inverse );
-	void* CPU_FFTDirection( void* args_ptr, bool reverse );
+	#ifdef __SSE__
+		#include <xmmintrin.h>
+	#endif
+	void CPU_ApplySensitivityDirection( void* args_ptr, bool inverse );
+	void CPU_FFTDirection( void* args_ptr, bool reverse );
+	void CPU_UpdateEstimateKernel( void* args_ptr );
 #endif
 
 #ifdef TCR_KERNEL_CUDA
@@ -14,9 +19,9 @@ __global__ void CUDA_ApplySensitivityDirection( float* coil_map, float* gradient
 {
 	int pixel_start = ( blockIdx.x*blockDim.x + threadIdx.x ) * thread_load;
 #else
-void* CPU_ApplySensitivity( void* args_ptr ) { return CPU_ApplySensitivityDirection( args_ptr, false); }
-void* CPU_ApplyInvSensitivity( void* args_ptr ) { return CPU_ApplySensitivityDirection( args_ptr, true ); }
-void* CPU_ApplySensitivityDirection( void* args_ptr, bool inverse )
+void* CPU_ApplySensitivity( void* args_ptr ) { CPU_ApplySensitivityDirection( args_ptr, false); return 0; }
+void* CPU_ApplyInvSensitivity( void* args_ptr ) { CPU_ApplySensitivityDirection( args_ptr, true ); return 0; }
+void CPU_ApplySensitivityDirection( void* args_ptr, bool inverse )
 {
 	KernelArgs* args = (KernelArgs*) args_ptr;
 	float* coil_map = args->coil_map;
@@ -89,9 +94,9 @@ void CUDA_FFTDirection( float* gradient, bool inverse, cufftHandle& plan, int im
 	}
 }
 #else
-void* CPU_FFT( void* args_ptr ) { return CPU_FFTDirection( args_ptr, false ); }
-void* CPU_IFFT( void* args_ptr ) { return CPU_FFTDirection( args_ptr, true); }
-void* CPU_FFTDirection( void* args_ptr, bool reverse )
+void* CPU_FFT( void* args_ptr ) { CPU_FFTDirection( args_ptr, false ); return 0; }
+void* CPU_IFFT( void* args_ptr ) { CPU_FFTDirection( args_ptr, true); return 0; }
+void CPU_FFTDirection( void* args_ptr, bool reverse )
 {
 	KernelArgs* args = (KernelArgs*) args_ptr;
 	int image_size = args->data_size.Column * args->data_size.Line;
@@ -110,21 +115,211 @@ void* CPU_FFTDirection( void* args_ptr, bool reverse )
 }
 #endif
 
-#ifdef TCR_KERNEL_CUDA
-__global__ void CUDA_ApplyFidelityDifference( float* gradient, float* meas_data, int num_pixels, int thread_load )
+#ifndef TCR_KERNEL_CUDA
+// images [first_image, last_image) of the chunk args covers
+static void GetImageRange( KernelArgs* args, int& first_image, int& last_image )
 {
-	int pixel_start = ( blockIdx.x*blockDim.x + threadIdx.x ) * thread_load;
-#else
+	int image_size = args->data_size.Column * args->data_size.Line;
+	int total_images = args->num_pixels / image_size;
+	int images_per_thread = (int)ceil( (float)total_images / args->num_threads );
+	first_image = args->thread_idx * images_per_thread;
+	last_image = first_image + images_per_thread;
+	if( last_image > total_images )
+		last_image = total_images;
+}
+
+// normal operator of one image of frame, minus the matching image of the gridded measurements
+static void CPU_NormalOperatorImage( KernelArgs* args, float* gradient_ptr, const float* meas_ptr, int frame )
+{
+	int columns = args->data_size.Column;
+	int lines = args->data_size.Line;
+	int image_size = columns * lines;
+	int padded_columns = 2 * columns;
+	int padded_size = 4 * image_size;
+
+	// images have their origin in the corner, so the quadrants go to the corners of the padded image
+	int split_column = ( columns + 1 ) / 2;
+	int split_line = ( lines + 1 ) / 2;
+	float* padded = args->toeplitz_buffer;
+	float* kernel_ptr = args->toeplitz_kernel + ( 2L * frame * padded_size );
+
+	memset( padded, 0, sizeof( float ) * 2 * padded_size );
+	for( int line = 0; line < lines; line++ )
+	{
+		float* padded_row = padded + 2L * ( ( line < split_line )? line: line + lines ) * padded_columns;
+		float* image_row = gradient_ptr + 2L * line * columns;
+		memcpy( padded_row, image_row, sizeof( float ) * 2 * split_column );
+		memcpy( padded_row + 2 * ( split_column + columns ), image_row + 2 * split_column, sizeof( float ) * 2 * ( columns - split_column ) );
+	}
+
+	// circular convolution with the point spread function
+	FilterTool::FFT2D( padded, padded, padded_columns, 2 * lines, false );
+	for( int j = 0; j < padded_size; j++ )
+	{
+		float real = padded[2*j];
+		float imag = padded[2*j+1];
+		padded[2*j] = real * kernel_ptr[2*j] - imag * kernel_ptr[2*j+1];
+		padded[2*j+1] = real * kernel_ptr[2*j+1] + imag * kernel_ptr[2*j];
+	}
+	FilterTool::FFT2D( padded, padded, padded_columns, 2 * lines, true );
+
+	// back out of the corners, minus the gridded measurements
+	for( int line = 0; line < lines; line++ )
+	{
+		float* padded_row = padded + 2L * ( ( line < split_line )? line: line + lines ) * padded_columns;
+		float* image_row = gradient_ptr + 2L * line * columns;
+		const float* meas_row = meas_ptr + 2L * line * columns;
+		for( int column = 0; column < columns; column++ )
+		{
+			int padded_column = ( column < split_column )? column: column + columns;
+			image_row[2*column] = padded_row[2*padded_column] - meas_row[2*column];
+			image_row[2*column+1] = padded_row[2*padded_column+1] - meas_row[2*column+1];
+		}
+	}
+}
+
+void* CPU_ApplyNormalOperator( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	int first_image, last_image;
+	GetImageRange( args, first_image, last_image );
+	int image_size = args->image_size;
+	for( int i = first_image; i < last_image; i++ )
+		CPU_NormalOperatorImage( args, args->gradient + 2L * i * image_size, args->meas_data + 2L * i * image_size, i % args->temp_dim_size );
+	return 0;
+}
+
+// subtracts the measured samples of meas_image from the k-space image and zeroes every location in between,
+// returns the squared norm of the difference
+static double CPU_SampledDifference( KernelArgs* args, float* image, int meas_image )
+{
+	const int* sample_index = args->sample_index;
+	const float* sample_values = args->sample_values;
+	int first_sample = args->sample_offsets[meas_image];
+	int last_sample = args->sample_offsets[meas_image+1];
+
+	double residual = 0;
+	int next = 0;
+	for( int k = first_sample; k < last_sample; k++ )
+	{
+		int j = sample_index[k];
+		memset( image + 2L * next, 0, sizeof( float ) * 2 * ( j - next ) );
+		image[2*j] -= sample_values[2*k];
+		image[2*j+1] -= sample_values[2*k+1];
+		residual += image[2*j] * image[2*j] + image[2*j+1] * image[2*j+1];
+		next = j + 1;
+	}
+	memset( image + 2L * next, 0, sizeof( float ) * 2 * ( args->image_size - next ) );
+	return residual;
+}
+
 void* CPU_ApplyFidelityDifference( void* args_ptr )
 {
 	KernelArgs* args = (KernelArgs*) args_ptr;
-	float* gradient = args->gradient;
-	float* meas_data = args->meas_data;
-	int pixel_start = args->pixel_start;
-	int thread_load = args->pixel_length;
-	int num_pixels = args->num_pixels;
+	int first_image, last_image;
+	GetImageRange( args, first_image, last_image );
+	for( int i = first_image; i < last_image; i++ )
+		CPU_SampledDifference( args, args->gradient + 2L * i * args->image_size, i );
+	return 0;
+}
+
+void* CPU_ApplyFidelity( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	int columns = args->data_size.Column;
+	int lines = args->data_size.Line;
+	int image_size = args->image_size;
+	int num_channels = args->data_size.Channel;
+	int num_slices = args->data_size.Slice;
+	float alpha = args->alpha;
+	int first_image, last_image;
+	GetImageRange( args, first_image, last_image );
+
+	int temp_dim_size = args->temp_dim_size;
+	int channels_per_image = ( args->coil_combined )? num_channels: 1;
+	bool calc_cost = args->calc_cost;
+	double residual = 0;
+
+	for( int i = first_image; i < last_image; i++ )
+	{
+		float* estimate = args->estimate + 2L * i * image_size;
+		float* gradient = args->gradient + 2L * i * image_size;
+		if( args->coil_combined )
+			memset( gradient, 0, sizeof( float ) * 2 * image_size );
+
+		for( int k = 0; k < channels_per_image; k++ )
+		{
+			// coil combined images go through every channel's image of the same frame
+			int meas_image = ( args->coil_combined )? ( ( i / temp_dim_size ) * num_channels + k ) * temp_dim_size + i % temp_dim_size: i;
+			int channel = ( meas_image / temp_dim_size ) % num_channels;
+			int slice = ( meas_image / ( temp_dim_size * num_channels ) ) % num_slices;
+			float* coil = args->coil_map + 2L * ( slice*args->coil_slice_size + channel*args->coil_channel_size );
+			float* meas_data = ( args->meas_data != 0 )? args->meas_data + 2L * meas_image * image_size: 0;
+			float* work = ( args->coil_combined )? args->scratch_image: gradient;
+
+			// sensitivity
+			for( int j = 0; j < image_size; j++ )
+			{
+				work[2*j] = estimate[2*j] * coil[2*j] - estimate[2*j+1] * coil[2*j+1];
+				work[2*j+1] = estimate[2*j+1] * coil[2*j] + estimate[2*j] * coil[2*j+1];
+			}
+
+			// fidelity difference
+			if( args->toeplitz_kernel != 0 )
+			{
+				CPU_NormalOperatorImage( args, work, meas_data, i % temp_dim_size );
+
+				// |A S x - y|^2 without |y|^2 is Re<S x, A^H A S x - A^H y> - Re<S x, A^H y>
+				if( calc_cost )
+				{
+					for( int j = 0; j < image_size; j++ )
+					{
+						float sx_real = estimate[2*j] * coil[2*j] - estimate[2*j+1] * coil[2*j+1];
+						float sx_imag = estimate[2*j+1] * coil[2*j] + estimate[2*j] * coil[2*j+1];
+						residual += sx_real * ( work[2*j] - meas_data[2*j] ) + sx_imag * ( work[2*j+1] - meas_data[2*j+1] );
+					}
+				}
+			}
+			else
+			{
+				FilterTool::FFT2D( work, work, columns, lines, false );
+				double image_residual = CPU_SampledDifference( args, work, meas_image );
+				if( calc_cost )
+					residual += image_residual;
+				FilterTool::FFT2D( work, work, columns, lines, true );
+			}
+
+			// conjugate sensitivity
+			for( int j = 0; j < image_size; j++ )
+			{
+				float real = alpha * ( work[2*j] * coil[2*j] + work[2*j+1] * coil[2*j+1] );
+				float imag = alpha * ( work[2*j+1] * coil[2*j] - work[2*j] * coil[2*j+1] );
+				if( args->coil_combined )
+				{
+					gradient[2*j] += real;
+					gradient[2*j+1] += imag;
+				}
+				else
+				{
+					gradient[2*j] = real;
+					gradient[2*j+1] = imag;
+				}
+			}
+		}
+	}
+
+	// the gradient above is alpha times the derivative of this, the unnormalized FFT scales k-space by image_size
+	if( calc_cost )
+		args->fidelity_cost = 0.5 * alpha * residual / ( ( args->toeplitz_kernel != 0 )? 1: image_size );
 
+	return 0;
+}
 #endif
+
+#ifdef TCR_KERNEL_CUDA
+__global__ void CUDA_ApplyFidelityDifference( float* gradient, float* meas_data, int num_pixels, int thread_load )
+{
+	int pixel_start = ( blockIdx.x*blockDim.x + threadIdx.x ) * thread_load;
 	int last_pixel = pixel_start + thread_load;
 	if( last_pixel > num_pixels)
 		last_pixel = num_pixels;
@@ -143,27 +338,12 @@ void* CPU_ApplyFidelityDifference( void* args_ptr )
 		}
 	}
 }
+#endif
 
 #ifdef TCR_KERNEL_CUDA
 __global__ void CUDA_CalcTemporalGradient( float* gradient, float* estimate, float* lambda_map, int image_size, int num_phases, float beta, float beta_squared, int num_pixels, int thread_load )
 {
 	int pixel_start = ( blockIdx.x*blockDim.x + threadIdx.x ) * thread_load;
-#else
-void* CPU_CalcTemporalGradient( void* args_ptr )
-{
-	KernelArgs* args = (KernelArgs*) args_ptr;
-	float* gradient = args->gradient;
-	float* estimate = args->estimate;
-	float* lambda_map = args->lambda_map;
-	int image_size = args->image_size;
-	int num_phases = args->temp_dim_size;
-	float beta = args->beta;
-	float beta_squared = args->beta_squared;
-	int pixel_start = args->pixel_start;
-	int thread_load = args->pixel_length;
-	int num_pixels = args->num_pixels;
-
-#endif
 	int last_pixel = pixel_start + thread_load;
 	if( last_pixel > num_pixels)
 		last_pixel = num_pixels;
@@ -203,13 +383,132 @@ void* CPU_CalcTemporalGradient( void* args_ptr )
 		//gradient[2*i+1] += (2*estimate[2*i+1] - estimate[2*idx_next_phase+1] - estimate[2*idx_prev_phase+1]) * beta;
 	}
 }
+#else
+// 1 / sqrt( x ) of length positive values, the SSE estimate gets one newton step which brings it to about float precision
+static void CPU_ReciprocalSqrt( const float* x, float* result, int length )
+{
+	int j = 0;
+#ifdef __SSE__
+	const __m128 half = _mm_set1_ps( 0.5f );
+	const __m128 three = _mm_set1_ps( 3.0f );
+	for( ; j + 4 <= length; j += 4 )
+	{
+		__m128 value = _mm_loadu_ps( x + j );
+		__m128 estimate = _mm_rsqrt_ps( value );
+		estimate = _mm_mul_ps( _mm_mul_ps( half, estimate ), _mm_sub_ps( three, _mm_mul_ps( value, _mm_mul_ps( estimate, estimate ) ) ) );
+		_mm_storeu_ps( result + j, estimate );
+	}
+#endif
+	for( ; j < length; j++ )
+		result[j] = 1.0f / sqrtf( x[j] );
+}
+
+// ( current - next ) / sqrt( |current - next|^2 + beta_squared ) of length complex pixels, returns sum of lambda * sqrt( ... )
+// when calc_cost is set
+static double CPU_NormalizedDifference( const float* current, const float* next, const float* lambda, float* difference, float* magnitude, float* scale, int length, float beta_squared, bool calc_cost )
+{
+	for( int j = 0; j < length; j++ )
+	{
+		float real = current[2*j] - next[2*j];
+		float imag = current[2*j+1] - next[2*j+1];
+		difference[2*j] = real;
+		difference[2*j+1] = imag;
+		magnitude[j] = real*real + imag*imag + beta_squared;
+	}
+	CPU_ReciprocalSqrt( magnitude, scale, length );
+	for( int j = 0; j < length; j++ )
+	{
+		difference[2*j] *= scale[j];
+		difference[2*j+1] *= scale[j];
+	}
+
+	double cost = 0;
+	if( calc_cost )
+		for( int j = 0; j < length; j++ )
+			cost += lambda[j] * magnitude[j] * scale[j];
+	return cost;
+}
+
+// frames of the same pixel are image_size apart, so a block of TCR_TV_BLOCK neighbouring pixels walks through time with
+// contiguous loads, every forward difference is normalized once and used for both frames it connects
+void* CPU_CalcTemporalGradient( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	int image_size = args->image_size;
+	int num_frames = args->temp_dim_size;
+	float beta = args->beta;
+	float beta_squared = args->beta_squared;
+	bool calc_cost = args->calc_cost;
+
+	// work units are pixel blocks of one (channel, slice, ...) group of frames
+	int blocks_per_image = ( image_size + TCR_TV_BLOCK - 1 ) / TCR_TV_BLOCK;
+	int total_units = ( args->num_pixels / ( image_size * num_frames ) ) * blocks_per_image;
+	int units_per_thread = (int)ceil( (float)total_units / args->num_threads );
+	int first_unit = args->thread_idx * units_per_thread;
+	int last_unit = first_unit + units_per_thread;
+	if( last_unit > total_units )
+		last_unit = total_units;
+
+	float wrap[2*TCR_TV_BLOCK];
+	float buffer_a[2*TCR_TV_BLOCK];
+	float buffer_b[2*TCR_TV_BLOCK];
+	float magnitude[TCR_TV_BLOCK];
+	float scale[TCR_TV_BLOCK];
+	double regularizer = 0;
+
+	for( int unit = first_unit; unit < last_unit; unit++ )
+	{
+		int group = unit / blocks_per_image;
+		int start = ( unit % blocks_per_image ) * TCR_TV_BLOCK;
+		int length = ( image_size - start < TCR_TV_BLOCK )? image_size - start: TCR_TV_BLOCK;
+		long offset = 2L * ( (long)group * num_frames * image_size + start );
+		const float* estimate = args->estimate + offset;
+		float* gradient = args->gradient + offset;
+		const float* lambda = args->lambda_map + start;
+		long frame_stride = 2L * image_size;
+
+		// the difference from the last frame back to the first closes the periodic boundary, it's the previous one of frame 0,
+		// with halos it comes from the previous process's last frame and that process counts its cost
+		long halo_offset = 2L * ( (long)group * image_size + start );
+		if( args->halo_previous != 0 )
+			CPU_NormalizedDifference( args->halo_previous + halo_offset, estimate, lambda, wrap, magnitude, scale, length, beta_squared, false );
+		else
+			regularizer += CPU_NormalizedDifference( estimate + ( num_frames - 1 ) * frame_stride, estimate, lambda, wrap, magnitude, scale, length, beta_squared, calc_cost );
+		const float* previous = wrap;
+		for( int t = 0; t < num_frames; t++ )
+		{
+			float* current = ( previous == buffer_a )? buffer_b: buffer_a;
+			if( t < num_frames - 1 )
+				regularizer += CPU_NormalizedDifference( estimate + t * frame_stride, estimate + ( t + 1 ) * frame_stride, lambda, current, magnitude, scale, length, beta_squared, calc_cost );
+			else if( args->halo_next != 0 )
+				regularizer += CPU_NormalizedDifference( estimate + t * frame_stride, args->halo_next + halo_offset, lambda, current, magnitude, scale, length, beta_squared, calc_cost );
+			else
+				current = wrap;
+
+			float* frame_gradient = gradient + t * frame_stride;
+			for( int j = 0; j < length; j++ )
+			{
+				float weight = beta * lambda[j];
+				frame_gradient[2*j] += ( current[2*j] - previous[2*j] ) * weight;
+				frame_gradient[2*j+1] += ( current[2*j+1] - previous[2*j+1] ) * weight;
+			}
+			previous = current;
+		}
+	}
+
+	if( calc_cost )
+		args->regularizer_cost = beta * regularizer;
+	return 0;
+}
+#endif
 
 #ifdef TCR_KERNEL_CUDA
 __global__ void CUDA_UpdateEstimate( float* gradient, float* estimate, int num_pixels, float step_size, int thread_load )
 {
 	int pixel_start = ( blockIdx.x*blockDim.x + threadIdx.x ) * thread_load;
 #else
-void* CPU_UpdateEstimate( void* args_ptr )
+void* CPU_UpdateEstimate( void* args_ptr ) { CPU_UpdateEstimateKernel( args_ptr ); return 0; }
+void CPU_UpdateEstimateKernel( void* args_ptr )
 {
 	KernelArgs* args = (KernelArgs*) args_ptr;
 	float* gradient = args->gradient;
@@ -233,3 +532,139 @@ void* CPU_UpdateEstimate( void* args_ptr )
 		//estimate[2*i+1] = gradient[2*i+1];
 	}
 }
+
+#ifndef TCR_KERNEL_CUDA
+// elements [first, last) of the chunk args covers, counting real and imaginary parts separately
+static void GetElementRange( KernelArgs* args, long& first, long& last )
+{
+	int last_pixel = args->pixel_start + args->pixel_length;
+	if( last_pixel > args->num_pixels )
+		last_pixel = args->num_pixels;
+	first = 2L * args->pixel_start;
+	last = ( last_pixel > args->pixel_start )? 2L * last_pixel: first;
+}
+
+// gradient was taken at the extrapolated estimate, previous_estimate holds the last gradient step
+void* CPU_NesterovUpdate( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	float* estimate = args->estimate;
+	float* gradient = args->gradient;
+	float* previous = args->previous_estimate;
+	float step_size = args->step_size;
+	float momentum = args->momentum;
+	long first, last;
+	GetElementRange( args, first, last );
+
+	for( long i = first; i < last; i++ )
+	{
+		float next = estimate[i] - step_size * gradient[i];
+		estimate[i] = next + momentum * ( next - previous[i] );
+		previous[i] = next;
+	}
+	return 0;
+}
+
+// <s, s>, <s, y> and <y, y> with s the last change of the estimate and y the last change of the gradient
+void* CPU_BarzilaiBorweinDots( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	long first, last;
+	GetElementRange( args, first, last );
+
+	double ss = 0;
+	double sy = 0;
+	double yy = 0;
+	for( long i = first; i < last; i++ )
+	{
+		double s = args->estimate[i] - args->previous_estimate[i];
+		double y = args->gradient[i] - args->previous_gradient[i];
+		ss += s * s;
+		sy += s * y;
+		yy += y * y;
+	}
+	args->dot_products[0] = ss;
+	args->dot_products[1] = sy;
+	args->dot_products[2] = yy;
+	return 0;
+}
+
+void* CPU_BarzilaiBorweinUpdate( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	float* estimate = args->estimate;
+	float* gradient = args->gradient;
+	float step = args->solver_step;
+	long first, last;
+	GetElementRange( args, first, last );
+
+	for( long i = first; i < last; i++ )
+	{
+		args->previous_estimate[i] = estimate[i];
+		args->previous_gradient[i] = gradient[i];
+		estimate[i] -= step * gradient[i];
+	}
+	return 0;
+}
+
+// <g, g>, <g, previous g> and <previous g, previous g> for the Polak-Ribiere coefficient
+void* CPU_ConjugateGradientDots( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	long first, last;
+	GetElementRange( args, first, last );
+
+	double gg = 0;
+	double gp = 0;
+	double pp = 0;
+	for( long i = first; i < last; i++ )
+	{
+		double g = args->gradient[i];
+		double p = args->previous_gradient[i];
+		gg += g * g;
+		gp += g * p;
+		pp += p * p;
+	}
+	args->dot_products[0] = gg;
+	args->dot_products[1] = gp;
+	args->dot_products[2] = pp;
+	return 0;
+}
+
+// direction = momentum * direction - gradient, keeps the gradient and returns <gradient, direction>, a momentum of 0
+// restarts from the gradient without reading the direction, which isn't initialized before the first step
+void* CPU_ConjugateDirection( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	float* gradient = args->gradient;
+	float* direction = args->direction;
+	float momentum = args->momentum;
+	long first, last;
+	GetElementRange( args, first, last );
+
+	double slope = 0;
+	for( long i = first; i < last; i++ )
+	{
+		direction[i] = ( momentum != 0 )? momentum * direction[i] - gradient[i]: -gradient[i];
+		args->previous_gradient[i] = gradient[i];
+		slope += (double)gradient[i] * direction[i];
+	}
+	args->dot_products[0] = slope;
+	args->dot_products[1] = 0;
+	args->dot_products[2] = 0;
+	return 0;
+}
+
+// trial_estimate = estimate + solver_step * direction
+void* CPU_LineSearchPoint( void* args_ptr )
+{
+	KernelArgs* args = (KernelArgs*) args_ptr;
+	float step = args->solver_step;
+	long first, last;
+	GetElementRange( args, first, last );
+
+	for( long i = first; i < last; i++ )
+		args->trial_estimate[i] = args->estimate[i] + step * args->direction[i];
+	return 0;
+}
+#endif
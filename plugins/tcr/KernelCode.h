@@ -3,6 +3,9 @@
 
 #include <MRIData.h>
 
+// pixels per temporal gradient work unit on the CPU, the scratch rows of one unit stay in L1
+#define TCR_TV_BLOCK 256
+
 class KernelArgs
 {
 	public:
@@ -18,11 +21,39 @@ class KernelArgs
 	int coil_slice_size;
 	int temp_dim_size;
 	MRIDimensions data_size;
+	// dense measurements, only kept for the toeplitz normal operator
 	float* meas_data;
+	// the sampled k-space locations of measurement image i are sample_index[sample_offsets[i]...sample_offsets[i+1]),
+	// in increasing order, with their complex values at the same positions of sample_values
+	int* sample_offsets;
+	int* sample_index;
+	float* sample_values;
 	float* coil_map;
 	float* estimate;
 	float* gradient;
 	float* lambda_map;
+	// one frame per group of frames, the ones just before the first and just after the last frame held by a neighbouring
+	// process, 0 closes the temporal gradient periodically over the frames here
+	float* halo_previous;
+	float* halo_next;
+	float* toeplitz_kernel;
+	float* toeplitz_buffer;
+	// estimate and gradient have a single coil combined channel, the fidelity term of every channel is summed into it
+	bool coil_combined;
+	float* scratch_image;
+	// partial cost sums of this chunk, only filled in while calc_cost is set
+	bool calc_cost;
+	double fidelity_cost;
+	double regularizer_cost;
+	// solver state, the buffers a solver doesn't use are 0
+	float* previous_estimate;
+	float* previous_gradient;
+	float* direction;
+	float* trial_estimate;
+	float solver_step;
+	float momentum;
+	// partial inner products of this chunk
+	double dot_products[3];
 	float alpha;
 	float beta;
 	float beta_squared;
@@ -42,8 +73,16 @@ void* CPU_ApplyInvSensitivity( void* args_ptr );
 void* CPU_ApplyFidelityDifference( void* args_ptr );
 void* CPU_FFT( void* args_ptr );
 void* CPU_IFFT( void* args_ptr );
+void* CPU_ApplyNormalOperator( void* args_ptr );
+void* CPU_ApplyFidelity( void* args_ptr );
 void* CPU_CalcTemporalGradient( void* args_ptr );
 void* CPU_UpdateEstimate( void* args_ptr );
+void* CPU_NesterovUpdate( void* args_ptr );
+void* CPU_BarzilaiBorweinDots( void* args_ptr );
+void* CPU_BarzilaiBorweinUpdate( void* args_ptr );
+void* CPU_ConjugateGradientDots( void* args_ptr );
+void* CPU_ConjugateDirection( void* args_ptr );
+void* CPU_LineSearchPoint( void* args_ptr );
 #endif
 
 
@@ -3,6 +3,8 @@
 #include <MRIDataSplitter.h>
 #include <GIRLogger.h>
 #include <math.h>
+#include <cstring>
+#include <algorithm>
 
 bool MPIPartitioner::SplitRepetitions( MRIData& full_data, MRIData& sub_data, int rank, int tasks, int overlap )
 {
@@ -19,21 +21,26 @@ bool MPIPartitioner::SplitRepetitions( MRIData& full_data, MRIData& sub_data, in
 		return false;
 	}
 
-	float reps_per_task = full_data.Size().Repetition / (float)tasks;
-
-	int body_start = (int)ceil( reps_per_task * rank );
-	int body_end = (int)ceil( reps_per_task * (rank+1) );
-
-	split_start = std::max( body_start - overlap, 0 );
-	split_end = std::min( body_end + overlap, full_data.Size().Repetition );
+	RepetitionRange( full_data.Size().Repetition, rank, tasks, overlap, split_start, split_end );
 	int split_size = split_end - split_start;
 
-	GIRLogger::LogDebug( "### SPLITTING -> reps_per_task: %f, split_start: %d, split_end: %d, split_size: %d...\n", reps_per_task, split_start, split_end, split_size );
+	GIRLogger::LogDebug( "### SPLITTING -> split_start: %d, split_end: %d, split_size: %d...\n", split_start, split_end, split_size );
 	GIRLogger::LogDebug( "\trank: %d, tasks: %d, overlap: %d...\n", rank, tasks, overlap );
 
 	return MRIDataSplitter::SplitRepetitions( full_data, sub_data, split_start, split_size );
 }
 
+void MPIPartitioner::RepetitionRange( int repetitions, int rank, int tasks, int overlap, int& split_start, int& split_end )
+{
+	float reps_per_task = repetitions / (float)tasks;
+
+	int body_start = (int)ceil( reps_per_task * rank );
+	int body_end = (int)ceil( reps_per_task * (rank+1) );
+
+	split_start = std::max( body_start - overlap, 0 );
+	split_end = std::min( body_end + overlap, repetitions );
+}
+
 bool MPIPartitioner::MergeRepetitions( MRIData& full_data, MRIData& sub_data, int rank, int tasks, int overlap )
 {
 
@@ -53,3 +60,108 @@ bool MPIPartitioner::MergeRepetitions( MRIData& full_data, MRIData& sub_data, in
 
 	return MRIDataSplitter::MergeRepetitions( full_data, sub_data, merge_start, sub_start_rep, merge_size );
 }
+
+int MPIPartitioner::AxisSize( const MRIDimensions& size, PartitionAxis axis )
+{
+	switch( axis )
+	{
+		case AXIS_SLICE: return size.Slice;
+		case AXIS_PARTITION: return size.Partition;
+		case AXIS_CHANNEL: return size.Channel;
+		default: return size.Repetition;
+	}
+}
+
+void MPIPartitioner::SetAxisSize( MRIDimensions& size, PartitionAxis axis, int value )
+{
+	switch( axis )
+	{
+		case AXIS_SLICE: size.Slice = value; break;
+		case AXIS_PARTITION: size.Partition = value; break;
+		case AXIS_CHANNEL: size.Channel = value; break;
+		default: size.Repetition = value; break;
+	}
+}
+
+void MPIPartitioner::AxisLayout( const MRIDimensions& size, PartitionAxis axis, bool is_complex, long& inner, long& outer )
+{
+	// memory order is column, line, channel, set, phase, slice, echo, repetition, partition, segment, average
+	inner = (long)size.Column * size.Line * ( ( is_complex )? 2: 1 );
+	outer = (long)size.Average * size.Segment;
+	if( axis == AXIS_CHANNEL )
+		outer *= (long)size.Partition * size.Repetition * size.Echo * size.Slice * size.Phase * size.Set;
+	else
+		inner *= size.Channel * size.Set * size.Phase;
+	if( axis == AXIS_SLICE )
+		outer *= (long)size.Partition * size.Repetition * size.Echo;
+	else if( axis != AXIS_CHANNEL )
+		inner *= size.Slice * size.Echo;
+	if( axis == AXIS_REPETITION )
+		outer *= size.Partition;
+	else if( axis == AXIS_PARTITION )
+		inner *= size.Repetition;
+}
+
+const char* MPIPartitioner::AxisName( PartitionAxis axis )
+{
+	switch( axis )
+	{
+		case AXIS_SLICE: return "slice";
+		case AXIS_PARTITION: return "partition";
+		case AXIS_CHANNEL: return "channel";
+		default: return "repetition";
+	}
+}
+
+bool MPIPartitioner::SplitAxis( MRIData& full_data, MRIData& sub_data, PartitionAxis axis, int start, int count )
+{
+	MRIDimensions sub_dims = full_data.Size();
+	SetAxisSize( sub_dims, axis, count );
+	sub_data = MRIData( sub_dims, full_data.IsComplex() );
+	return MergeAxis( sub_data, full_data, axis, 0, start, count );
+}
+
+bool MPIPartitioner::MergeAxis( MRIData& full_data, MRIData& sub_data, PartitionAxis axis, int start, int sub_start, int count )
+{
+	int full_size = AxisSize( full_data.Size(), axis );
+	int sub_size = AxisSize( sub_data.Size(), axis );
+	MRIDimensions full_check = full_data.Size();
+	MRIDimensions sub_check = sub_data.Size();
+	SetAxisSize( full_check, axis, 1 );
+	SetAxisSize( sub_check, axis, 1 );
+	if( count < 1 || start < 0 || start + count > full_size || sub_start < 0 || sub_start + count > sub_size || !full_check.Equals( sub_check ) || full_data.IsComplex() != sub_data.IsComplex() )
+	{
+		GIRLogger::LogError( "MPIPartitioner::MergeAxis -> %d %ss from %d of %s don't fit %d of %s, aborting!\n", count, AxisName( axis ), sub_start, sub_data.Size().ToString().c_str(), start, full_data.Size().ToString().c_str() );
+		return false;
+	}
+
+	// one contiguous block of count indices in every layer above the axis
+	long inner;
+	long outer;
+	AxisLayout( full_data.Size(), axis, full_data.IsComplex(), inner, outer );
+	for( long i = 0; i < outer; i++ )
+		memcpy( full_data.GetDataStart() + ( i * full_size + start ) * inner, sub_data.GetDataStart() + ( i * sub_size + sub_start ) * inner, sizeof( float ) * count * inner );
+	return true;
+}
+
+PartitionAxis MPIPartitioner::ChooseAxis( const MRIDimensions& size, int tasks, int overlap, bool allow_channel )
+{
+	if( tasks < 2 )
+		return AXIS_REPETITION;
+
+	// an even spread without any overlap or communication
+	if( size.Slice >= tasks && size.Slice % tasks == 0 )
+		return AXIS_SLICE;
+	if( size.Partition >= tasks && size.Partition % tasks == 0 )
+		return AXIS_PARTITION;
+
+	if( size.Repetition >= tasks * MPI_MIN_BODY_OVERLAPS * std::max( overlap, 1 ) )
+		return AXIS_REPETITION;
+	if( size.Slice >= tasks )
+		return AXIS_SLICE;
+	if( size.Partition >= tasks )
+		return AXIS_PARTITION;
+	if( allow_channel && size.Channel >= tasks )
+		return AXIS_CHANNEL;
+	return AXIS_REPETITION;
+}
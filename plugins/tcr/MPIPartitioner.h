@@ -1,13 +1,36 @@
 #ifndef MPI_PARTITIONER_H
 #define MPI_PARTITIONER_H
 class MRIData;
+class MRIDimensions;
+
+// the dimension the data is split along, slices and partitions reconstruct independently, repetitions need an
+// overlap or halo exchange and channels a reduction of the coil combined terms
+enum PartitionAxis { AXIS_REPETITION, AXIS_SLICE, AXIS_PARTITION, AXIS_CHANNEL };
+
+// repetitions a task's body needs for an overlapping repetition split to be worth its overlap, in overlaps
+#define MPI_MIN_BODY_OVERLAPS 2
 
 class MPIPartitioner
 {
 	public:
 	static bool SplitRepetitions( MRIData& full_data, MRIData& sub_data, int rank, int tasks, int overlap );
 	static bool SplitRepetitions( MRIData& full_data, MRIData& sub_data, int rank, int tasks, int overlap, int& split_start, int& split_end );
+	// writes only the body of part rank into full_data, so parts can be merged in any order as they complete
 	static bool MergeRepetitions( MRIData& full_data, MRIData& sub_data, int rank, int tasks, int overlap );
+	// the repetitions SplitRepetitions would copy, for sending them straight out of the full data
+	static void RepetitionRange( int repetitions, int rank, int tasks, int overlap, int& split_start, int& split_end );
+
+	// disjoint splits along any axis, count indices from start, merged from sub_start on
+	static bool SplitAxis( MRIData& full_data, MRIData& sub_data, PartitionAxis axis, int start, int count );
+	static bool MergeAxis( MRIData& full_data, MRIData& sub_data, PartitionAxis axis, int start, int sub_start, int count );
+	static int AxisSize( const MRIDimensions& size, PartitionAxis axis );
+	static void SetAxisSize( MRIDimensions& size, PartitionAxis axis, int value );
+	// elements below one index of axis in memory order and how often that block repeats above it
+	static void AxisLayout( const MRIDimensions& size, PartitionAxis axis, bool is_complex, long& inner, long& outer );
+	static const char* AxisName( PartitionAxis axis );
+	// independent slices or partitions first, then repetitions while every task gets enough of them for the overlap,
+	// then channels if the caller can reduce over them
+	static PartitionAxis ChooseAxis( const MRIDimensions& size, int tasks, int overlap, bool allow_channel );
 };
 
 #endif
@@ -2,6 +2,7 @@
 #include <MRIData.h>
 #include <GIRLogger.h>
 #include <mpi.h>
+#include <cstdio>
 
 bool MPITools::SendData( MRIData& data, int rep_offset, int rank, MPI_Comm comm )
 {
@@ -83,6 +84,164 @@ bool MPITools::ReceiveData( MRIData& data, int& rep_offset, int rank, MPI_Comm c
 	return status2 == MPI_SUCCESS;
 }
 
+bool MPITools::ISendRange( MRIData& data, PartitionAxis axis, int start, int count, int rep_offset, int rank, MPI_Comm comm, MPISend& send )
+{
+	MRIDimensions dims = data.Size();
+	int axis_size = MPIPartitioner::AxisSize( dims, axis );
+	if( start < 0 || count < 1 || start + count > axis_size )
+	{
+		GIRLogger::LogError( "MPITools::ISendRange -> %ss %d to %d out of %d, aborting!\n", MPIPartitioner::AxisName( axis ), start, start + count, axis_size );
+		return false;
+	}
+
+	// the same header SendData sends for the split
+	MPIPartitioner::SetAxisSize( dims, axis, count );
+	send.header_buffer.resize( dims.GetNumDims() + 2 );
+	int dim_size = 0;
+	for( int i = 0; i < dims.GetNumDims(); i++ )
+	{
+		dims.GetDim( i, dim_size );
+		send.header_buffer[i] = dim_size;
+	}
+	send.header_buffer[dims.GetNumDims()] = ( data.IsComplex() )? 1: 0;
+	send.header_buffer[dims.GetNumDims()+1] = rep_offset;
+
+	// every layer above the axis holds the range as one contiguous block
+	long inner;
+	long outer;
+	MPIPartitioner::AxisLayout( data.Size(), axis, data.IsComplex(), inner, outer );
+	MPI_Type_vector( (int)outer, (int)( count * inner ), (int)( axis_size * inner ), MPI_FLOAT, &send.data_type );
+	MPI_Type_commit( &send.data_type );
+
+	float* first = data.GetDataStart() + start * inner;
+	if
+	(
+		MPI_Isend( &send.header_buffer[0], (int)send.header_buffer.size(), MPI_INT, rank, MRI_HEADER_TAG, comm, &send.requests[0] ) != MPI_SUCCESS ||
+		MPI_Isend( first, 1, send.data_type, rank, MRI_DATA_TAG, comm, &send.requests[1] ) != MPI_SUCCESS
+	)
+	{
+		GIRLogger::LogError( "MPITools::ISendRange -> MPI_Isend failed!\n" );
+		return false;
+	}
+	return true;
+}
+
+bool MPITools::WaitSend( MPISend& send )
+{
+	bool success = ( MPI_Waitall( 2, send.requests, MPI_STATUSES_IGNORE ) == MPI_SUCCESS );
+	MPI_Type_free( &send.data_type );
+	if( !success )
+		GIRLogger::LogError( "MPITools::WaitSend -> MPI_Waitall failed!\n" );
+	return success;
+}
+
+bool MPITools::ReceiveAnyData( MRIData& data, int& rep_offset, int& rank, MPI_Comm comm )
+{
+	MPI_Status status;
+	if( MPI_Probe( MPI_ANY_SOURCE, MRI_HEADER_TAG, comm, &status ) != MPI_SUCCESS )
+	{
+		GIRLogger::LogError( "MPITools::ReceiveAnyData -> MPI_Probe failed!\n" );
+		return false;
+	}
+	rank = status.MPI_SOURCE;
+	return ReceiveData( data, rep_offset, rank, comm );
+}
+
+bool MPITools::WriteRepetitionFile( MRIData& data, const char* path )
+{
+	MRIDimensions dims = data.Size();
+	std::vector<int> header( dims.GetNumDims() + 2 );
+	header[0] = MRI_REPETITION_FILE_MAGIC;
+	for( int i = 0; i < dims.GetNumDims(); i++ )
+		dims.GetDim( i, header[i+1] );
+	header[dims.GetNumDims()+1] = ( data.IsComplex() )? 1: 0;
+
+	FILE* file = fopen( path, "wb" );
+	if( file == 0 )
+	{
+		GIRLogger::LogError( "MPITools::WriteRepetitionFile -> unable to open \"%s\"!\n", path );
+		return false;
+	}
+	bool success = fwrite( &header[0], sizeof( int ), header.size(), file ) == header.size() && 
+		fwrite( data.GetDataStart(), sizeof( float ), data.NumElements(), file ) == (size_t)data.NumElements();
+	if( fclose( file ) != 0 || !success )
+	{
+		GIRLogger::LogError( "MPITools::WriteRepetitionFile -> writing \"%s\" failed!\n", path );
+		remove( path );
+		return false;
+	}
+	return true;
+}
+
+bool MPITools::OpenRepetitionFile( const char* path, RepetitionFile& file, MPI_Comm comm )
+{
+	int rank;
+	MPI_Comm_rank( comm, &rank );
+
+	// a zero magic tells the other ranks there is no repetition file
+	MRIDimensions dims;
+	std::vector<int> header( dims.GetNumDims() + 2, 0 );
+	if( rank == 0 )
+	{
+		FILE* input = fopen( path, "rb" );
+		if( input != 0 )
+		{
+			if( fread( &header[0], sizeof( int ), header.size(), input ) != header.size() )
+				header[0] = 0;
+			fclose( input );
+		}
+	}
+	MPI_Bcast( &header[0], (int)header.size(), MPI_INT, 0, comm );
+	if( header[0] != MRI_REPETITION_FILE_MAGIC )
+		return false;
+
+	for( int i = 0; i < dims.GetNumDims(); i++ )
+		if( !dims.SetDim( i, header[i+1] ) )
+			return false;
+	file.path = path;
+	file.size = dims;
+	file.is_complex = header[dims.GetNumDims()+1] == 1;
+	return true;
+}
+
+bool MPITools::ReadRange( RepetitionFile& file, PartitionAxis axis, int start, int count, MRIData& data, MPI_Comm comm )
+{
+	MRIDimensions dims = file.size;
+	int axis_size = MPIPartitioner::AxisSize( dims, axis );
+	if( start < 0 || count < 1 || start + count > axis_size )
+	{
+		GIRLogger::LogError( "MPITools::ReadRange -> %ss %d to %d out of %d, aborting!\n", MPIPartitioner::AxisName( axis ), start, start + count, axis_size );
+		return false;
+	}
+	MPIPartitioner::SetAxisSize( dims, axis, count );
+	data = MRIData( dims, file.is_complex );
+
+	// the same blocks ISendRange sends, seen through the file
+	long inner;
+	long outer;
+	MPIPartitioner::AxisLayout( file.size, axis, file.is_complex, inner, outer );
+	MPI_Datatype file_type;
+	MPI_Type_vector( (int)outer, (int)( count * inner ), (int)( axis_size * inner ), MPI_FLOAT, &file_type );
+	MPI_Type_commit( &file_type );
+	MPI_Offset first = ( MRIDimensions::GetNumDims() + 2 ) * (MPI_Offset)sizeof( int ) + start * inner * (MPI_Offset)sizeof( float );
+
+	MPI_File input;
+	bool success = false;
+	if( MPI_File_open( comm, (char*)file.path.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &input ) == MPI_SUCCESS )
+	{
+		MPI_Status status;
+		int read_count = 0;
+		success = MPI_File_set_view( input, first, MPI_FLOAT, file_type, (char*)"native", MPI_INFO_NULL ) == MPI_SUCCESS &&
+			MPI_File_read_all( input, data.GetDataStart(), data.NumElements(), MPI_FLOAT, &status ) == MPI_SUCCESS &&
+			MPI_Get_count( &status, MPI_FLOAT, &read_count ) == MPI_SUCCESS && read_count == data.NumElements();
+		MPI_File_close( &input );
+	}
+	MPI_Type_free( &file_type );
+	if( !success )
+		GIRLogger::LogError( "MPITools::ReadRange -> reading %ss %d to %d from \"%s\" failed!\n", MPIPartitioner::AxisName( axis ), start, start + count, file.path.c_str() );
+	return success;
+}
+
 /*
 bool MPITools::SendParameters( float alpha, float beta, float step_size, int iterations, bool is_pc, int rank, MPI_Comm comm )
 {
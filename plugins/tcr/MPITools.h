@@ -1,19 +1,53 @@
 #ifndef MPI_TOOLS_H
 #define MPI_TOOLS_H
 
+#include <MRIData.h>
+#include <MPIPartitioner.h>
 #include <mpi.h>
-
-class MRIData;
+#include <string>
+#include <vector>
 
 const int MRI_HEADER_TAG = 0;
 const int MRI_DATA_TAG = 1;
 const int MRI_PARAMETERS_TAG = 1;
 
+// a non-blocking send, has to stay in place until WaitSend returns
+struct MPISend
+{
+	std::vector<int> header_buffer;
+	MPI_Datatype data_type;
+	MPI_Request requests[2];
+};
+
+// marks a repetition file, the header of ints that follows holds the dims in GetDim order and the complexity, then
+// the floats of the data in memory order, so every range of repetitions, or of any other axis, sits at a known offset
+// in each layer above it
+const int MRI_REPETITION_FILE_MAGIC = 0x53504552;
+
+struct RepetitionFile
+{
+	std::string path;
+	MRIDimensions size;
+	bool is_complex;
+};
+
 class MPITools
 {
 	public:
 	static bool SendData( MRIData& data, int rep_offset, int rank, MPI_Comm comm );
 	static bool ReceiveData( MRIData& data, int& rep_offset, int rank, MPI_Comm comm );
+	// starts sending count indices of axis from start on straight out of data the way SendData sends a split of them,
+	// data must stay untouched until WaitSend
+	static bool ISendRange( MRIData& data, PartitionAxis axis, int start, int count, int rep_offset, int rank, MPI_Comm comm, MPISend& send );
+	static bool WaitSend( MPISend& send );
+	// receives what SendData sent from whichever rank is first, rank is set to it
+	static bool ReceiveAnyData( MRIData& data, int& rep_offset, int& rank, MPI_Comm comm );
+
+	static bool WriteRepetitionFile( MRIData& data, const char* path );
+	// collective, the first rank of comm reads the header and shares it, false if path is no repetition file
+	static bool OpenRepetitionFile( const char* path, RepetitionFile& file, MPI_Comm comm );
+	// collective, every rank of comm reads its own count indices of axis from start on with MPI-IO
+	static bool ReadRange( RepetitionFile& file, PartitionAxis axis, int start, int count, MRIData& data, MPI_Comm comm );
 
 	/*
 	static bool SendParameters( float alpha, float beta, float step_size, int iterations, bool is_pc, int rank, MPI_Comm comm );
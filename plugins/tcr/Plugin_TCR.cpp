@@ -1,9 +1,14 @@
 #include <MRIDataTool.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
 #include <FilterTool.h>
 #include <Serializable.h>
 #include <GIRLogger.h>
 #include <GIRConfig.h>
 #include <Plugin_TCR.h>
+#include <FileCommunicator.h>
 #include <TCRIteratorCPU.h>
 #ifndef NO_CUDA
 	#include <TCRIteratorCUDA.h>
@@ -19,6 +24,101 @@ extern "C" void destroy( ReconPlugin* plugin )
 	delete plugin;
 }
 
+// smallest column or line count a coarse level is solved at
+#define TCR_MIN_COARSE_SIZE 16
+
+// copies the frames of seed overlapping estimate into estimate, seed frame seed_offset landing on frame 0
+static bool SeedEstimate( MRIData& estimate, const MRIData& seed, int temp_dim_index, int seed_offset )
+{
+	MRIDimensions est_size = estimate.Size();
+	MRIDimensions seed_size = seed.Size();
+	long inner_size = 1;
+	long outer_size = 1;
+	int est_frames = 1;
+	int seed_frames = 1;
+	for( int i = 0; i < MRIDimensions::GetNumDims(); i++ )
+	{
+		int est_dim = 1;
+		int seed_dim = 1;
+		est_size.GetDim( i, est_dim );
+		seed_size.GetDim( i, seed_dim );
+		if( i == temp_dim_index )
+		{
+			est_frames = est_dim;
+			seed_frames = seed_dim;
+		}
+		else if( est_dim != seed_dim )
+		{
+			GIRLogger::LogError( "Plugin_TCR::SeedEstimate -> seed size %s does not match estimate size %s!\n", seed_size.ToString().c_str(), est_size.ToString().c_str() );
+			return false;
+		}
+		else if( i < temp_dim_index )
+			inner_size *= est_dim;
+		else
+			outer_size *= est_dim;
+	}
+
+	int frames = std::min( est_frames, seed_frames - seed_offset );
+	if( seed_offset < 0 || frames < 1 || !seed.IsComplex() || !estimate.IsComplex() )
+	{
+		GIRLogger::LogError( "Plugin_TCR::SeedEstimate -> seed has no frames overlapping the estimate at offset %d!\n", seed_offset );
+		return false;
+	}
+
+	float* est_data = estimate.GetDataStart();
+	float* seed_data = seed.GetDataStart();
+	for( long i = 0; i < outer_size; i++ )
+		memcpy( est_data + 2 * i * est_frames * inner_size, seed_data + 2 * ( i * seed_frames + seed_offset ) * inner_size, 2 * frames * inner_size * sizeof( float ) );
+
+	GIRLogger::LogInfo( "Plugin_TCR::SeedEstimate -> seeded %d of %d frames\n", frames, est_frames );
+	return true;
+}
+
+// crops or zero pads the centered k-space of src to columns x lines, scaled to keep image intensities
+static void ResizeKSpace( const MRIData& src, MRIData& dest, int columns, int lines )
+{
+	MRIDimensions src_size = src.Size();
+	MRIDimensions dest_size = src_size;
+	dest_size.Column = columns;
+	dest_size.Line = lines;
+	dest = MRIData( dest_size, true );
+	dest.SetAll( 0 );
+
+	int column_shift = src_size.Column / 2 - columns / 2;
+	int line_shift = src_size.Line / 2 - lines / 2;
+	float scale = (float)columns * lines / ( (float)src_size.Column * src_size.Line );
+	long num_images = dest.NumPixels() / ( columns * lines );
+	float* src_data = src.GetDataStart();
+	float* dest_data = dest.GetDataStart();
+
+	for( long i = 0; i < num_images; i++ )
+	for( int line = 0; line < lines; line++ )
+	{
+		int src_line = line + line_shift;
+		if( src_line < 0 || src_line >= src_size.Line )
+			continue;
+		float* dest_row = dest_data + 2 * ( i * lines + line ) * columns;
+		float* src_row = src_data + 2 * ( i * src_size.Line + src_line ) * src_size.Column;
+		for( int column = std::max( 0, -column_shift ); column < std::min( columns, src_size.Column - column_shift ); column++ )
+		{
+			dest_row[2*column] = scale * src_row[2*( column + column_shift )];
+			dest_row[2*column+1] = scale * src_row[2*( column + column_shift ) + 1];
+		}
+	}
+}
+
+// interpolates the corner-shifted images of estimate to columns x lines by zero padding their k-space
+static void UpsampleEstimate( MRIData& estimate, int columns, int lines )
+{
+	FilterTool::FFT2D( estimate );
+	FilterTool::FFTShift( estimate, true );
+	MRIData resized;
+	ResizeKSpace( estimate, resized, columns, lines );
+	estimate = resized;
+	FilterTool::FFTShift( estimate );
+	FilterTool::FFT2D( estimate, true );
+}
+
 bool Plugin_TCR::Configure( GIRConfig& config, bool main_config, bool final_config )
 {
 	bool success = true;
@@ -27,9 +127,21 @@ bool Plugin_TCR::Configure( GIRConfig& config, bool main_config, bool final_conf
 	config.GetParam( plugin_id.c_str(), alias.c_str(), "beta_squared", beta_squared );
 	config.GetParam( plugin_id.c_str(), alias.c_str(), "step_size", step_size );
 	config.GetParam( plugin_id.c_str(), alias.c_str(), "iterations", iterations );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "check_interval", check_interval );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "tolerance", tolerance );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "time_limit", time_limit );
 	config.GetParam( plugin_id.c_str(), alias.c_str(), "threads", threads);
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "pin_threads", pin_threads );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "calibrate", calibrate );
 	config.GetParam( plugin_id.c_str(), alias.c_str(), "use_gpu", use_gpu );
 	config.GetParam( plugin_id.c_str(), alias.c_str(), "gpu_thread_load", gpu_thread_load );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "coil_combined", coil_combined );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "warm_start_file", warm_start_file );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "warm_start_offset", warm_start_offset );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "coarse_levels", coarse_levels );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "coarse_iterations", coarse_iterations );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "checkpoint_file", checkpoint_file );
+	config.GetParam( plugin_id.c_str(), alias.c_str(), "checkpoint_interval", checkpoint_interval );
 
 	std::string temp_dim_string;
 	if( config.GetParam( plugin_id.c_str(), alias.c_str(), "temporal_dimension", temp_dim_string ) )
@@ -42,6 +154,24 @@ bool Plugin_TCR::Configure( GIRConfig& config, bool main_config, bool final_conf
 			GIRLogger::LogError( "Plugin_TCR::Configure -> invalid temporal_dimension: \"%s\"!\n", temp_dim_string.c_str() );
 	}
 
+	std::string solver_string;
+	if( config.GetParam( plugin_id.c_str(), alias.c_str(), "solver", solver_string ) )
+	{
+		if( solver_string.compare( "gradient_descent" ) == 0 )
+			solver = TCRIterator::SOLVER_GRADIENT_DESCENT;
+		else if( solver_string.compare( "nesterov" ) == 0 )
+			solver = TCRIterator::SOLVER_NESTEROV;
+		else if( solver_string.compare( "conjugate_gradient" ) == 0 )
+			solver = TCRIterator::SOLVER_CONJUGATE_GRADIENT;
+		else if( solver_string.compare( "barzilai_borwein" ) == 0 )
+			solver = TCRIterator::SOLVER_BARZILAI_BORWEIN;
+		else
+		{
+			GIRLogger::LogError( "Plugin_TCR::Configure -> invalid solver: \"%s\"!\n", solver_string.c_str() );
+			success = false;
+		}
+	}
+
 	if( alpha < 0 )
 	{
 		GIRLogger::LogError( "Plugin_TCR::Configure -> alpha cannot be less than 0 as specified!\n" );
@@ -66,9 +196,15 @@ bool Plugin_TCR::Configure( GIRConfig& config, bool main_config, bool final_conf
 		success = false;
 	}
 
-	if( threads < 1 )
+	if( check_interval < 0 || tolerance < 0 || time_limit < 0 )
+	{
+		GIRLogger::LogError( "Plugin_TCR::Configure -> check_interval, tolerance and time_limit cannot be less than 0 as specified!\n" );
+		success = false;
+	}
+
+	if( threads < 0 )
 	{
-		GIRLogger::LogError( "Plugin_TCR::Configure -> threads cannot be less than 1 as specified!\n" );
+		GIRLogger::LogError( "Plugin_TCR::Configure -> threads cannot be less than 0 as specified!\n" );
 		success = false;
 	}
 
@@ -78,25 +214,39 @@ bool Plugin_TCR::Configure( GIRConfig& config, bool main_config, bool final_conf
 		success = false;
 	}
 
+	if( warm_start_offset < 0 || coarse_levels < 0 || coarse_iterations < 0 )
+	{
+		GIRLogger::LogError( "Plugin_TCR::Configure -> warm_start_offset, coarse_levels and coarse_iterations cannot be less than 0 as specified!\n" );
+		success = false;
+	}
+
+	if( checkpoint_interval < 0 )
+	{
+		GIRLogger::LogError( "Plugin_TCR::Configure -> checkpoint_interval cannot be less than 0 as specified!\n" );
+		success = false;
+	}
+
+	if( coil_combined && use_gpu )
+	{
+		GIRLogger::LogError( "Plugin_TCR::Configure -> coil_combined is only supported on the CPU!\n" );
+		success = false;
+	}
+
 	return success;
 }
 
-bool Plugin_TCR::Reconstruct( MRIData& mri_data )
+// runs num_iterations on the corner shifted k_space, starting from the frames of seed where given and from the
+// checkpoint if resumable, result takes the estimate's size so it may be the seed or an empty MRIData
+bool Plugin_TCR::Solve( MRIData& k_space, const MRIData* seed, int seed_offset, int num_iterations, bool resumable, MRIData& result )
 {
-	// scale data
-	mri_data.ScaleMax( 150 );
-
-	// shift to corner
-	FilterTool::FFTShift( mri_data );
-
 	// generate original estimate from interpolated k-space to get rid of blurring
-	GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> generating original estimate...\n" );
+	GIRLogger::LogInfo( "Plugin_TCR::Solve -> generating original estimate...\n" );
 	MRIData estimate;
-	MRIDataTool::TemporallyInterpolateKSpace( mri_data, estimate );
+	MRIDataTool::TemporallyInterpolateKSpace( k_space, estimate );
 	FilterTool::FFT2D( estimate, true );
 	
 	// generate coil map
-	GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> generating coil map...\n" );
+	GIRLogger::LogInfo( "Plugin_TCR::Solve -> generating coil map...\n" );
 	MRIData coil_map;
 	MRIDataTool::GetCoilSense( estimate, coil_map );
 
@@ -108,33 +258,150 @@ bool Plugin_TCR::Reconstruct( MRIData& mri_data )
 	}
 	catch( ... )
 	{
-		GIRLogger::LogError( "Plugin_TCR::Reconstruct -> lambda map generation failed, FIX THIS!\n" );
+		GIRLogger::LogError( "Plugin_TCR::Solve -> lambda map generation failed, FIX THIS!\n" );
 		MRIDimensions lambda_dims( estimate.Size().Column, estimate.Size().Line, 1, 1, 1, 1, 1, 1, 1, 1, 1 );
 		lambda_map = MRIData( lambda_dims, false );
 		lambda_map.SetAll( 1 );
 	}
 
+	// start from the seed where it covers the estimate
+	int temp_dim_index = ( temp_dim == TCRIterator::TEMP_DIM_REP ) ? 7 : 4;
+	if( seed != 0 && !coil_combined && !SeedEstimate( estimate, *seed, temp_dim_index, seed_offset ) )
+		GIRLogger::LogInfo( "Plugin_TCR::Solve -> ignoring seed, starting from interpolated estimate\n" );
+
 	// iterate
 	if( use_gpu )
 	{
 #ifndef NO_CUDA
-		GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> reconstructing on GPU...\n" );
+		GIRLogger::LogInfo( "Plugin_TCR::Solve -> reconstructing on GPU...\n" );
 		TCRIteratorCUDA iterator( gpu_thread_load, temp_dim );
-		iterator.Load( alpha, beta, beta_squared, step_size, mri_data, estimate, coil_map, lambda_map );
-		iterator.Iterate( iterations );
-		iterator.Unload( mri_data );
+		iterator.SetStoppingCriteria( check_interval, tolerance, time_limit );
+		iterator.SetSolver( solver );
+		iterator.Load( alpha, beta, beta_squared, step_size, k_space, estimate, coil_map, lambda_map );
+		if( resumable )
+		{
+			iterator.SetCheckpoint( checkpoint_file.c_str(), checkpoint_interval );
+			iterator.Resume();
+		}
+		iterator.Iterate( num_iterations );
+		iterator.Unload( estimate );
+		result = estimate;
 #else
-		GIRLogger::LogError( "Plugin_TCR::Reconstruct -> GPU requested but binaries not build with CUDA, aborting!\n" );
+		GIRLogger::LogError( "Plugin_TCR::Solve -> GPU requested but binaries not build with CUDA, aborting!\n" );
 		return false;
 #endif
 	}
 	else
 	{
-		GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> reconstructing on CPU(s)...\n" );
+		GIRLogger::LogInfo( "Plugin_TCR::Solve -> reconstructing on CPU(s)...\n" );
 		TCRIteratorCPU iterator( threads, temp_dim );
-		iterator.Load( alpha, beta, beta_squared, step_size, mri_data, estimate, coil_map, lambda_map );
-		iterator.Iterate( iterations );
-		iterator.Unload( mri_data );
+		iterator.SetStoppingCriteria( check_interval, tolerance, time_limit );
+		iterator.SetSolver( solver );
+		iterator.SetThreadPinning( pin_threads );
+		iterator.SetCalibration( calibrate );
+		if( coil_combined )
+		{
+			// iterate on one combined image per frame instead of one per channel
+			MRIData combined_estimate;
+			MRIDataTool::CoilCombine( estimate, coil_map, combined_estimate );
+			if( seed != 0 && !SeedEstimate( combined_estimate, *seed, temp_dim_index, seed_offset ) )
+				GIRLogger::LogInfo( "Plugin_TCR::Solve -> ignoring seed, starting from combined interpolated estimate\n" );
+			estimate = MRIData();
+			iterator.Load( alpha, beta, beta_squared, step_size, k_space, combined_estimate, coil_map, lambda_map );
+			if( resumable )
+			{
+				iterator.SetCheckpoint( checkpoint_file.c_str(), checkpoint_interval );
+				iterator.Resume();
+			}
+			iterator.Iterate( num_iterations );
+			iterator.Unload( combined_estimate );
+			result = combined_estimate;
+		}
+		else
+		{
+			iterator.Load( alpha, beta, beta_squared, step_size, k_space, estimate, coil_map, lambda_map );
+			if( resumable )
+			{
+				iterator.SetCheckpoint( checkpoint_file.c_str(), checkpoint_interval );
+				iterator.Resume();
+			}
+			iterator.Iterate( num_iterations );
+			iterator.Unload( estimate );
+			result = estimate;
+		}
+	}
+
+	return true;
+}
+
+bool Plugin_TCR::Reconstruct( MRIData& mri_data )
+{
+	// scale data
+	mri_data.ScaleMax( 150 );
+	int columns = mri_data.Size().Column;
+	int lines = mri_data.Size().Line;
+
+	// start from the estimate cached by a previous reconstruction of the same series
+	MRIData seed;
+	bool seeded = false;
+	int seed_offset = 0;
+	if( !warm_start_file.empty() )
+	{
+		FileCommunicator communicator;
+		if( communicator.OpenInput( warm_start_file.c_str() ) && communicator.ReceiveData( seed ) )
+		{
+			GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> warm starting from \"%s\"...\n", warm_start_file.c_str() );
+			seeded = true;
+			seed_offset = warm_start_offset;
+		}
+		else
+			GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> no cached estimate in \"%s\", starting cold\n", warm_start_file.c_str() );
+	}
+
+	// otherwise solve downsampled matrices first, each result seeding the next finer level, unless the full matrix
+	// solve resumes from a checkpoint anyway
+	bool resumable = !checkpoint_file.empty();
+	if( !seeded && coarse_levels > 0 && !( resumable && access( checkpoint_file.c_str(), F_OK ) == 0 ) )
+	{
+		for( int level = coarse_levels; level > 0; level-- )
+		{
+			int level_columns = columns >> level;
+			int level_lines = lines >> level;
+			if( level_columns < TCR_MIN_COARSE_SIZE || level_lines < TCR_MIN_COARSE_SIZE )
+			{
+				GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> skipping level %d, %dx%d is too small\n", level, level_columns, level_lines );
+				continue;
+			}
+
+			GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> solving level %d at %dx%d...\n", level, level_columns, level_lines );
+			MRIData level_data;
+			ResizeKSpace( mri_data, level_data, level_columns, level_lines );
+			FilterTool::FFTShift( level_data );
+			if( seeded )
+				UpsampleEstimate( seed, level_columns, level_lines );
+			if( !Solve( level_data, ( seeded ) ? &seed : 0, 0, coarse_iterations, false, seed ) )
+				return false;
+			seeded = true;
+		}
+
+		if( seeded )
+			UpsampleEstimate( seed, columns, lines );
+	}
+
+	// shift to corner
+	FilterTool::FFTShift( mri_data );
+
+	if( !Solve( mri_data, ( seeded ) ? &seed : 0, seed_offset, iterations, resumable, mri_data ) )
+		return false;
+	if( resumable )
+		remove( checkpoint_file.c_str() );
+
+	// cache the result for the next reconstruction
+	if( !warm_start_file.empty() )
+	{
+		FileCommunicator communicator;
+		if( !communicator.OpenOutput( warm_start_file.c_str() ) || !communicator.SendData( mri_data ) )
+			GIRLogger::LogError( "Plugin_TCR::Reconstruct -> unable to cache estimate in \"%s\"!\n", warm_start_file.c_str() );
 	}
 
 	// shift to center
@@ -4,13 +4,14 @@
 #include <ReconPlugin.h>
 #include <Serializable.h>
 #include <TCRIterator.h>
+#include <string>
 
 class GIRConfig;
 
 class Plugin_TCR: public ReconPlugin
 {
 	public:
-	Plugin_TCR( const char* new_plugin_id, const char* new_alias ): ReconPlugin( new_plugin_id, new_alias ), alpha( 1 ), beta( 1 ), beta_squared( 0.00001 ), step_size( 1 ), iterations( 10 ), threads( 1 ), use_gpu( false ), gpu_thread_load( 1 ), temp_dim( TCRIterator::TEMP_DIM_PHASE ) {}
+	Plugin_TCR( const char* new_plugin_id, const char* new_alias ): ReconPlugin( new_plugin_id, new_alias ), alpha( 1 ), beta( 1 ), beta_squared( 0.00001 ), step_size( 1 ), iterations( 10 ), check_interval( 0 ), tolerance( 0 ), time_limit( 0 ), threads( 0 ), pin_threads( false ), calibrate( false ), use_gpu( false ), gpu_thread_load( 1 ), coil_combined( false ), warm_start_offset( 0 ), coarse_levels( 0 ), coarse_iterations( 10 ), checkpoint_interval( 0 ), temp_dim( TCRIterator::TEMP_DIM_PHASE ), solver( TCRIterator::SOLVER_GRADIENT_DESCENT ) {}
 
 	protected:
 	float alpha;
@@ -18,14 +19,34 @@ class Plugin_TCR: public ReconPlugin
 	float beta_squared;
 	float step_size;
 	int iterations;
+	int check_interval;
+	float tolerance;
+	float time_limit;
+	// work chunks of the CPU iterator, 0 picks them from the available processors
 	int threads;
+	bool pin_threads;
+	bool calibrate;
 	bool use_gpu;
 	int gpu_thread_load;
+	bool coil_combined;
+	// estimate of a previous reconstruction used as starting point and replaced by the new result
+	std::string warm_start_file;
+	// frame of the cached estimate matching the first frame of this reconstruction
+	int warm_start_offset;
+	// number of downsampled levels solved before the full matrix, each halving columns and lines
+	int coarse_levels;
+	int coarse_iterations;
+	// the full matrix solve dumps its estimate to checkpoint_file every checkpoint_interval iterations and a restarted
+	// reconstruction continues from it, the file is removed once the reconstruction finishes
+	std::string checkpoint_file;
+	int checkpoint_interval;
 	TCRIterator::TemporalDimension temp_dim;
+	TCRIterator::Solver solver;
 
 	bool Configure( GIRConfig& config, bool main_config, bool final_config );
 	bool Reconstruct( MRIData& mri_data );
 	bool Reconstruct( std::vector<MRIMeasurement>& meas_vector, MRIData& mri_data );
+	bool Solve( MRIData& k_space, const MRIData* seed, int seed_offset, int num_iterations, bool resumable, MRIData& result );
 };
 
 #endif
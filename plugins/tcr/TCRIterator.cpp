@@ -1,6 +1,31 @@
 #include <TCRIterator.h>
 #include <GIRLogger.h>
 #include <MRIData.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cstring>
+#include <cmath>
+
+#define TCR_CHECKPOINT_MAGIC 0x54435231
+
+// leads the raw estimate in a checkpoint file, iteration is -1 while the estimate is being written
+struct CheckpointHeader
+{
+	int magic;
+	int iteration;
+	int temp_dim;
+	int temp_dim_size;
+	long length;
+};
+
+TCRIterator::~TCRIterator()
+{
+	if( checkpoint_map != 0 )
+		munmap( checkpoint_map, checkpoint_map_size );
+}
 
 void TCRIterator::Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& estimate, MRIData& coil_map, MRIData& lambda_map )
 {
@@ -17,29 +42,229 @@ void TCRIterator::Load( float alpha, float beta, float beta_squared, float step_
 	GIRLogger::LogDebug( "### temp_dim_size: %d\n", temp_dim_size );
 }
 
+bool TCRIterator::LoadToeplitz( MRIData& src_kernel )
+{
+	GIRLogger::LogError( "TCRIterator::LoadToeplitz -> not supported by this iterator, using the cartesian fidelity term!\n" );
+	return false;
+}
+
+bool TCRIterator::SetSolver( Solver new_solver )
+{
+	if( new_solver != SOLVER_GRADIENT_DESCENT )
+	{
+		GIRLogger::LogError( "TCRIterator::SetSolver -> solver %d not supported by this iterator, using gradient descent!\n", new_solver );
+		return false;
+	}
+	solver = new_solver;
+	return true;
+}
+
+void TCRIterator::SetStoppingCriteria( int new_check_interval, float new_tolerance, float new_time_limit )
+{
+	check_interval = new_check_interval;
+	tolerance = new_tolerance;
+	time_limit = new_time_limit;
+}
+
+void TCRIterator::SetCheckpoint( const char* new_checkpoint_path, int new_checkpoint_interval )
+{
+	if( checkpoint_map != 0 )
+	{
+		munmap( checkpoint_map, checkpoint_map_size );
+		checkpoint_map = 0;
+	}
+	checkpoint_path = new_checkpoint_path;
+	checkpoint_interval = new_checkpoint_interval;
+}
+
+int TCRIterator::Resume()
+{
+	start_iteration = 0;
+	if( checkpoint_path.empty() )
+		return 0;
+
+	ResetSolverState();
+	long length = 0;
+	float* dest = CheckpointEstimate( length );
+	if( dest == 0 )
+	{
+		GIRLogger::LogError( "TCRIterator::Resume -> checkpoints not supported by this iterator, starting over!\n" );
+		return 0;
+	}
+
+	int checkpoint_fd = open( checkpoint_path.c_str(), O_RDONLY );
+	if( checkpoint_fd < 0 )
+	{
+		GIRLogger::LogInfo( "TCRIterator::Resume -> no checkpoint at \"%s\", starting over...\n", checkpoint_path.c_str() );
+		return 0;
+	}
+
+	struct stat checkpoint_stat;
+	size_t size = sizeof( CheckpointHeader ) + length * sizeof( float );
+	if( fstat( checkpoint_fd, &checkpoint_stat ) != 0 || checkpoint_stat.st_size != (off_t)size )
+	{
+		GIRLogger::LogError( "TCRIterator::Resume -> checkpoint \"%s\" has the wrong size for the loaded data, starting over!\n", checkpoint_path.c_str() );
+		close( checkpoint_fd );
+		return 0;
+	}
+
+	void* map = mmap( 0, size, PROT_READ, MAP_PRIVATE, checkpoint_fd, 0 );
+	close( checkpoint_fd );
+	if( map == MAP_FAILED )
+	{
+		GIRLogger::LogError( "TCRIterator::Resume -> unable to map checkpoint \"%s\", starting over!\n", checkpoint_path.c_str() );
+		return 0;
+	}
+
+	const CheckpointHeader* header = (const CheckpointHeader*)map;
+	if( header->magic != TCR_CHECKPOINT_MAGIC || header->iteration < 0 || header->temp_dim != temp_dim || header->temp_dim_size != temp_dim_size || header->length != length )
+		GIRLogger::LogError( "TCRIterator::Resume -> checkpoint \"%s\" is incomplete or from other data, starting over!\n", checkpoint_path.c_str() );
+	else
+	{
+		memcpy( dest, header + 1, length * sizeof( float ) );
+		start_iteration = header->iteration;
+		GIRLogger::LogInfo( "TCRIterator::Resume -> resuming after %d iterations from \"%s\"...\n", start_iteration, checkpoint_path.c_str() );
+	}
+	munmap( map, size );
+	return start_iteration;
+}
+
+bool TCRIterator::WriteCheckpoint( int iteration )
+{
+	long length = 0;
+	float* source = CheckpointEstimate( length );
+	if( source == 0 )
+	{
+		GIRLogger::LogError( "TCRIterator::WriteCheckpoint -> checkpoints not supported by this iterator, disabling them!\n" );
+		checkpoint_interval = 0;
+		return false;
+	}
+
+	// map the file once, later checkpoints only copy into it
+	size_t size = sizeof( CheckpointHeader ) + length * sizeof( float );
+	if( checkpoint_map != 0 && checkpoint_map_size != size )
+	{
+		munmap( checkpoint_map, checkpoint_map_size );
+		checkpoint_map = 0;
+	}
+	if( checkpoint_map == 0 )
+	{
+		int checkpoint_fd = open( checkpoint_path.c_str(), O_RDWR | O_CREAT, 0644 );
+		void* map = MAP_FAILED;
+		if( checkpoint_fd >= 0 && ftruncate( checkpoint_fd, size ) == 0 )
+			map = mmap( 0, size, PROT_READ | PROT_WRITE, MAP_SHARED, checkpoint_fd, 0 );
+		if( checkpoint_fd >= 0 )
+			close( checkpoint_fd );
+		if( map == MAP_FAILED )
+		{
+			GIRLogger::LogError( "TCRIterator::WriteCheckpoint -> unable to map \"%s\", disabling checkpoints!\n", checkpoint_path.c_str() );
+			checkpoint_interval = 0;
+			return false;
+		}
+		checkpoint_map = map;
+		checkpoint_map_size = size;
+	}
+
+	CheckpointHeader* header = (CheckpointHeader*)checkpoint_map;
+	header->iteration = -1;
+	memcpy( header + 1, source, length * sizeof( float ) );
+	header->magic = TCR_CHECKPOINT_MAGIC;
+	header->temp_dim = temp_dim;
+	header->temp_dim_size = temp_dim_size;
+	header->length = length;
+	header->iteration = iteration;
+
+	// the page cache outlives the process, only ask for the write back without waiting for it
+	msync( checkpoint_map, checkpoint_map_size, MS_ASYNC );
+	GIRLogger::LogDebug( "TCRIterator::WriteCheckpoint -> iteration %d written to \"%s\"\n", iteration, checkpoint_path.c_str() );
+	return true;
+}
+
 void TCRIterator::Iterate( int iterations )
 {
-	// perform iterations
-	for( int i = 0; i < iterations; i++ )
+	timeval start_time;
+	gettimeofday( &start_time, 0 );
+	bool have_last_cost = false;
+	double last_cost = 0;
+
+	// perform iterations, a resumed run skips the ones its checkpoint covers
+	int first_iteration = start_iteration;
+	start_iteration = 0;
+	for( int i = first_iteration; i < iterations; i++ )
 	{
 		GIRLogger::LogInfo( "TCRIterator::Iterate -> iteration: %d...\n", i );
+		calc_cost = ( check_interval > 0 && i % check_interval == 0 );
 
 		// fidelity sense term
-		ApplySensitivity();
-		FFT();
-		ApplyFidelityDifference();
-		IFFT();
-		ApplyInvSensitivity();
+		ApplyFidelity();
 
 		// temporal gradient term
 		CalcTemporalGradient();
+
+		// cost of the estimate this gradient belongs to
+		bool converged = false;
+		if( calc_cost )
+		{
+			double fidelity = 0;
+			double regularizer = 0;
+			if( !GetCost( fidelity, regularizer ) )
+			{
+				GIRLogger::LogError( "TCRIterator::Iterate -> cost not supported by this iterator, convergence monitoring disabled.\n" );
+				check_interval = 0;
+			}
+			else
+			{
+				double cost = fidelity + regularizer;
+				double change = ( have_last_cost && last_cost != 0 )? fabs( cost - last_cost ) / fabs( last_cost ): 1;
+				GIRLogger::LogInfo( "TCRIterator::Iterate -> iteration: %d cost: %g fidelity: %g regularizer: %g change: %g\n", i, cost, fidelity, regularizer, change );
+				converged = ( have_last_cost && change < tolerance );
+				have_last_cost = true;
+				last_cost = cost;
+			}
+		}
 		
 		// update estimate
 		UpdateEstimate();
+
+		if( checkpoint_interval > 0 && ( i + 1 ) % checkpoint_interval == 0 )
+			WriteCheckpoint( i + 1 );
+
+		if( converged )
+		{
+			GIRLogger::LogInfo( "TCRIterator::Iterate -> converged after %d iterations.\n", i+1 );
+			break;
+		}
+
+		if( time_limit > 0 )
+		{
+			timeval now;
+			gettimeofday( &now, 0 );
+			double elapsed = ( now.tv_sec - start_time.tv_sec ) + ( now.tv_usec - start_time.tv_usec ) / 1e6;
+			if( SharedStop( elapsed > time_limit ) )
+			{
+				GIRLogger::LogInfo( "TCRIterator::Iterate -> time limit of %gs reached after %d iterations.\n", time_limit, i+1 );
+				break;
+			}
+		}
 	}
+	calc_cost = false;
 	GIRLogger::LogInfo( "TCRIterator::Iterate -> done iterating.\n" );
 }
 
+void TCRIterator::ApplyFidelity()
+{
+	ApplySensitivity();
+	if( use_toeplitz )
+		ApplyNormalOperator();
+	else
+	{
+		FFT();
+		ApplyFidelityDifference();
+		IFFT();
+	}
+	ApplyInvSensitivity();
+}
+
 void TCRIterator::Order( MRIData& mri_data, float* dest )
 {
 	//TODO: this probably isn't a good way to do this
@@ -1,6 +1,9 @@
 #ifndef TCR_ITERATOR_H
 #define TCR_ITERATOR_H
 
+#include <string>
+#include <cstddef>
+
 class MRIData;
 class MRIDimensions;
 
@@ -8,28 +11,72 @@ class TCRIterator
 {
 	public:
 	enum TemporalDimension { TEMP_DIM_PHASE, TEMP_DIM_REP };
+	// how UpdateEstimate uses the gradient, SOLVER_GRADIENT_DESCENT is the fixed step_size update every iterator supports
+	enum Solver { SOLVER_GRADIENT_DESCENT, SOLVER_NESTEROV, SOLVER_CONJUGATE_GRADIENT, SOLVER_BARZILAI_BORWEIN };
 
-	TCRIterator( TemporalDimension new_temp_dim ): temp_dim( new_temp_dim ) {}
-	virtual ~TCRIterator() {}
+	TCRIterator( TemporalDimension new_temp_dim ): temp_dim( new_temp_dim ), use_toeplitz( false ), solver( SOLVER_GRADIENT_DESCENT ), check_interval( 0 ), tolerance( 0 ), time_limit( 0 ), calc_cost( false ), checkpoint_interval( 0 ), start_iteration( 0 ), checkpoint_map( 0 ), checkpoint_map_size( 0 ) {}
+	virtual ~TCRIterator();
 
 	virtual void Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& estimate, MRIData& coil_map, MRIData& lambda_map );
+	// after Load, replaces FFT / ApplyFidelityDifference / IFFT with the normal operator of a non-cartesian trajectory,
+	// src_kernel is RadialGridder::GetToeplitzKernel of one frame per temporal index and src_meas_data has to have been
+	// the measured data gridded without flattening and FFT2D'd back to image space instead of cartesian k-space
+	virtual bool LoadToeplitz( MRIData& src_kernel );
 	virtual void Unload( MRIData& estimate ) = 0;
 	virtual void Iterate( int iterations );
+	// every check_interval iterations the cost is logged and iterating stops once its relative change since the last
+	// check is below tolerance, iterating also stops after time_limit seconds, 0 disables each of them
+	void SetStoppingCriteria( int new_check_interval, float new_tolerance, float new_time_limit );
+	// before Load, returns false and keeps gradient descent if the iterator doesn't support new_solver
+	virtual bool SetSolver( Solver new_solver );
+	// every new_checkpoint_interval iterations Iterate dumps the estimate and the iteration count into a file mapped
+	// at checkpoint_path, 0 disables it
+	void SetCheckpoint( const char* new_checkpoint_path, int new_checkpoint_interval );
+	// after Load, continues from the checkpoint at checkpoint_path if it was written for data of the loaded size,
+	// the next Iterate skips the iterations it covers and the solver starts over from its estimate, returns them
+	virtual int Resume();
 
 	protected:
 	TemporalDimension temp_dim;
 	int temp_dim_size;
+	bool use_toeplitz;
+	Solver solver;
+	int check_interval;
+	float tolerance;
+	float time_limit;
+	// set by Iterate for the iterations whose cost is checked
+	bool calc_cost;
+	std::string checkpoint_path;
+	int checkpoint_interval;
+	int start_iteration;
+	void* checkpoint_map;
+	size_t checkpoint_map_size;
+
+	bool WriteCheckpoint( int iteration );
 
 	void Order( MRIData& mri_data, float* dest );
 	void Unorder( MRIData& mri_data, float* source );
 
+	// the whole fidelity term, ApplySensitivity through ApplyInvSensitivity
+	virtual void ApplyFidelity();
 	virtual void ApplySensitivity() = 0;
 	virtual void ApplyInvSensitivity() = 0;
 	virtual void FFT() = 0;
 	virtual void IFFT() = 0;
 	virtual void ApplyFidelityDifference() = 0;
+	virtual void ApplyNormalOperator() {}
 	virtual void CalcTemporalGradient() = 0;
 	virtual void UpdateEstimate() = 0;
+	// data consistency and regularizer terms of the estimate the last ApplyFidelity and CalcTemporalGradient ran on
+	// while calc_cost was set, returns false if the iterator can't compute them
+	virtual bool GetCost( double& fidelity, double& regularizer ) { return false; }
+	// the ordered estimate Unload would return and its length in floats, 0 if the iterator can't checkpoint
+	virtual float* CheckpointEstimate( long& length ) { return 0; }
+	// forgets the solver's history before Resume overwrites the estimate
+	virtual void ResetSolverState() {}
+	// whether to stop iterating because of the time limit, iterators working in step with others on other processes
+	// have to agree on it
+	virtual bool SharedStop( bool stop ) { return stop; }
 };
 
 #endif
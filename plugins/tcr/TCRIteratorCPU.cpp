@@ -5,16 +5,31 @@
 #include <FilterTool.h>
 #include <KernelCode.h>
 #include <vector>
-#include <pthread.h>
 #include <cmath>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <sys/time.h>
+
+// backtracking halves the step at most this often before the conjugate gradient direction is dropped
+#define TCR_MAX_BACKTRACKS 20
+// fraction of the predicted decrease a trial step has to reach
+#define TCR_ARMIJO_FACTOR 1e-4
+// automatic chunking, the default and the most chunks per pool thread, more than one so uneven chunks even out
+#define TCR_CHUNKS_PER_THREAD 4
+#define TCR_MAX_CHUNKS_PER_THREAD 8
 
 TCRIteratorCPU::~TCRIteratorCPU()
 {
-	if( meas_data != 0 ) { delete [] meas_data; meas_data = 0; }
+	FreeMeasData();
 	if( estimate != 0 ) { delete [] estimate; estimate = 0; }
 	if( gradient != 0 ) { delete [] gradient; gradient = 0; }
 	if( coil_map != 0 ) { delete [] coil_map; coil_map = 0; }
 	if( lambda_map != 0 ) { delete [] lambda_map; lambda_map = 0; }
+	if( toeplitz_kernel != 0 ) { delete [] toeplitz_kernel; toeplitz_kernel = 0; }
+	if( toeplitz_buffers != 0 ) { delete [] toeplitz_buffers; toeplitz_buffers = 0; }
+	if( scratch_images != 0 ) { delete [] scratch_images; scratch_images = 0; }
+	FreeSolverBuffers();
 }
 
 void TCRIteratorCPU::Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& src_estimate, MRIData& src_coil_map, MRIData& src_lambda_map )
@@ -22,21 +37,79 @@ void TCRIteratorCPU::Load( float alpha, float beta, float beta_squared, float st
 	// call parent
 	TCRIterator::Load( alpha, beta, beta_squared, step_size, src_meas_data, src_estimate, src_coil_map, src_lambda_map );
 
-	// make sure sizes are compatible
-	if( !src_meas_data.Size().Equals( src_estimate.Size() ) )
+	// make sure sizes are compatible, the estimate either has every channel or is coil combined, the channels are
+	// compared apart so a combined estimate doesn't log a mismatch
+	MRIDimensions channel_size = src_estimate.Size();
+	channel_size.Channel = src_meas_data.Size().Channel;
+	bool coil_combined = ( src_meas_data.Size().Channel > 1 && src_estimate.Size().Channel == 1 );
+	if( ( src_estimate.Size().Channel != src_meas_data.Size().Channel && !coil_combined ) || !src_meas_data.Size().Equals( channel_size ) )
 	{
-		GIRLogger::LogError( "TCRIteratorCPU::Load -> src_meas_data is not the same size as src_estimate, aborting!\n" );
+		GIRLogger::LogError( "TCRIteratorCPU::Load -> src_estimate %s is neither the size of src_meas_data %s nor coil combined, aborting!\n", src_estimate.Size().ToString().c_str(), src_meas_data.Size().ToString().c_str() );
 		return;
 	}
 
-	// load meas_data
-	if( meas_data != 0 ) delete[] meas_data;
-	meas_data = new float[src_meas_data.NumElements()];
-	Order( src_meas_data, meas_data );
+	// chunk counts, whole images for the fidelity term and pixel blocks of whole frame series for the temporal gradient
+	int est_images = src_estimate.NumPixels() / ( src_meas_data.Size().Column * src_meas_data.Size().Line );
+	int pool_threads = thread_pool->NumThreads();
+	if( auto_chunks )
+	{
+		num_threads = ( pin_threads )? pool_threads: std::max( pool_threads, std::min( est_images, TCR_MAX_CHUNKS_PER_THREAD * pool_threads ) );
+		args.resize( num_threads );
+	}
+	int temporal_units = ( est_images / temp_dim_size ) * (int)ceil( (float)( src_meas_data.Size().Column * src_meas_data.Size().Line ) / TCR_TV_BLOCK );
+	SetChunks( image_chunks, "fidelity", est_images );
+	SetChunks( temporal_chunks, "temporal gradient", temporal_units );
+	vector_chunks = ( auto_chunks && !pin_threads )? std::min( pool_threads, num_threads ): num_threads;
+	GIRLogger::LogInfo( "TCRIteratorCPU::Load -> %d chunks for the fidelity term, %d for the temporal gradient, %d for updates...\n", image_chunks.chunks, temporal_chunks.chunks, vector_chunks );
+
+	// load meas_data, keeping only the sampled k-space locations of every image
+	FreeMeasData();
+	float* dense_meas = new float[src_meas_data.NumElements()];
+	Order( src_meas_data, dense_meas );
+	meas_pixels = src_meas_data.NumPixels();
+	int meas_image_size = src_meas_data.Size().Column * src_meas_data.Size().Line;
+	int meas_images = meas_pixels / meas_image_size;
+	int num_samples = 0;
+	sample_offsets = new int[meas_images + 1];
+	for( int i = 0; i < meas_images; i++ )
+	{
+		sample_offsets[i] = num_samples;
+		for( int j = i * meas_image_size; j < ( i + 1 ) * meas_image_size; j++ )
+			if( fabs( dense_meas[2*j] ) > 1e-20 || fabs( dense_meas[2*j+1] ) > 1e-20 )
+				num_samples++;
+	}
+	sample_offsets[meas_images] = num_samples;
+	sample_index = new int[num_samples];
+	sample_values = new float[2L * num_samples];
+	if( pin_threads )
+	{
+		// a chunk's estimate images come with the measurements of all their channels
+		std::vector<long> sample_bounds = ImageBounds( est_images, meas_images / est_images );
+		for( int i = 0; i < (int)sample_bounds.size(); i++ )
+			sample_bounds[i] = sample_offsets[sample_bounds[i]];
+		FirstTouch( sample_index, sizeof( int ), sample_bounds );
+		for( int i = 0; i < (int)sample_bounds.size(); i++ )
+			sample_bounds[i] *= 2;
+		FirstTouch( sample_values, sizeof( float ), sample_bounds );
+	}
+	for( int i = 0, k = 0; i < meas_pixels; i++ )
+	{
+		if( fabs( dense_meas[2*i] ) > 1e-20 || fabs( dense_meas[2*i+1] ) > 1e-20 )
+		{
+			sample_index[k] = i % meas_image_size;
+			sample_values[2*k] = dense_meas[2*i];
+			sample_values[2*k+1] = dense_meas[2*i+1];
+			k++;
+		}
+	}
+	delete[] dense_meas;
+	GIRLogger::LogInfo( "TCRIteratorCPU::Load -> %d of %d k-space locations sampled...\n", num_samples, meas_pixels );
 
 	// load estimate
 	if( estimate != 0 ) delete[] estimate;
 	estimate = new float[src_estimate.NumElements()];
+	if( pin_threads )
+		PlaceEstimateBuffer( estimate, est_images, meas_image_size );
 	Order( src_estimate, estimate );
 
 	// load coil_map
@@ -49,11 +122,22 @@ void TCRIteratorCPU::Load( float alpha, float beta, float beta_squared, float st
 	lambda_map = new float[src_lambda_map.NumElements()];
 	Order( src_lambda_map, lambda_map );
 
-	// allocate gradient
+	// allocate gradient, only as big as the estimate it updates
+	if( gradient != 0 ) delete[] gradient;
 	gradient = new float[src_estimate.NumElements()];
+	if( pin_threads )
+		PlaceEstimateBuffer( gradient, est_images, meas_image_size );
 
-	// set max_pixel and pixels_per_thread
-	int num_pixels = src_meas_data.NumPixels();
+	int image_size = src_meas_data.Size().Column * src_meas_data.Size().Line;
+	if( scratch_images != 0 ) { delete[] scratch_images; scratch_images = 0; }
+	if( coil_combined )
+	{
+		GIRLogger::LogInfo( "TCRIteratorCPU::Load -> coil combined estimate, summing %d channels...\n", src_meas_data.Size().Channel );
+		scratch_images = new float[2L * image_size * num_threads];
+	}
+
+	// set max_pixel and pixels_per_thread, the steps after the fidelity term only go over the estimate
+	int num_pixels = src_estimate.NumPixels();
 	int pixels_per_thread = (int)ceil( (float)num_pixels / num_threads );
 
 	// initialize thread data
@@ -73,7 +157,21 @@ void TCRIteratorCPU::Load( float alpha, float beta, float beta_squared, float st
 		args[i].temp_dim_size = temp_dim_size;
 		args[i].coil_map = coil_map;
 		args[i].lambda_map = lambda_map;
-		args[i].meas_data = meas_data;
+		args[i].halo_previous = 0;
+		args[i].halo_next = 0;
+		args[i].toeplitz_kernel = 0;
+		args[i].toeplitz_buffer = 0;
+		args[i].coil_combined = coil_combined;
+		args[i].scratch_image = ( coil_combined )? scratch_images + 2L * image_size * i: 0;
+		args[i].calc_cost = false;
+		args[i].fidelity_cost = 0;
+		args[i].regularizer_cost = 0;
+		args[i].solver_step = step_size;
+		args[i].momentum = 0;
+		args[i].meas_data = 0;
+		args[i].sample_offsets = sample_offsets;
+		args[i].sample_index = sample_index;
+		args[i].sample_values = sample_values;
 		args[i].estimate = estimate;
 		args[i].gradient = gradient;
 		args[i].alpha = alpha;
@@ -81,84 +179,542 @@ void TCRIteratorCPU::Load( float alpha, float beta, float beta_squared, float st
 		args[i].beta_squared = beta_squared;
 		args[i].step_size = step_size;
 	}
+
+	// solver state belongs to the previous estimate
+	ResetSolverState();
+
+	if( pin_threads )
+	{
+		std::stringstream placement;
+		for( int i = 0; i < num_threads; i++ )
+			placement << " " << i << ":" << thread_pool->WorkerNode( i % thread_pool->NumThreads() );
+		GIRLogger::LogInfo( "TCRIteratorCPU::Load -> chunk:node%s\n", placement.str().c_str() );
+	}
+}
+
+void TCRIteratorCPU::ResetSolverState()
+{
+	FreeSolverBuffers();
+	gradient_current = false;
+	restart_direction = true;
+	nesterov_t = 1;
+	if( !args.empty() )
+		line_step = args[0].step_size;
+	SetSolverArgs();
+}
+
+float* TCRIteratorCPU::CheckpointEstimate( long& length )
+{
+	if( estimate == 0 || args.empty() )
+		return 0;
+	length = 2L * args[0].num_pixels;
+	return ( solver == SOLVER_NESTEROV && previous_estimate != 0 )? previous_estimate: estimate;
+}
+
+bool TCRIteratorCPU::SetSolver( Solver new_solver )
+{
+	solver = new_solver;
+	return true;
+}
+
+// chunk counts of a kernel with work_units independent pieces of work, fixed when pinned since the first touch placed
+// the data for num_threads chunks, otherwise a few chunks per worker so dynamic scheduling evens out uneven units
+void TCRIteratorCPU::SetChunks( KernelChunks& kernel, const char* name, int work_units )
+{
+	int pool_threads = thread_pool->NumThreads();
+	int max_chunks = std::max( 1, std::min( num_threads, work_units ) );
+	kernel.name = name;
+	kernel.chunks = ( auto_chunks && !pin_threads )? std::min( max_chunks, TCR_CHUNKS_PER_THREAD * pool_threads ): num_threads;
+	kernel.last = kernel.chunks;
+	kernel.candidates.clear();
+	kernel.seconds.clear();
+	if( calibrate && !pin_threads )
+	{
+		for( int chunks = pool_threads; chunks < max_chunks; chunks *= 2 )
+			kernel.candidates.push_back( chunks );
+		kernel.candidates.push_back( max_chunks );
+	}
+}
+
+bool TCRIteratorCPU::SetThreadPinning( bool new_pin_threads )
+{
+	pin_threads = ( new_pin_threads && thread_pool->PinThreads() );
+	return ( pin_threads == new_pin_threads );
+}
+
+// runs job on the first chunks args, split evenly over the estimate
+void TCRIteratorCPU::RunChunks( void* (*job)( void* ), int chunks )
+{
+	int pixels_per_chunk = (int)ceil( (float)args[0].num_pixels / chunks );
+	std::vector<void*> job_args( chunks );
+	for( int i = 0; i < chunks; i++ )
+	{
+		args[i].num_threads = chunks;
+		args[i].pixel_start = i * pixels_per_chunk;
+		args[i].pixel_length = pixels_per_chunk;
+		job_args[i] = (void*)&args[i];
+	}
+	thread_pool->RunJobs( job, job_args, pin_threads );
+}
+
+static double Seconds()
+{
+	timeval now;
+	gettimeofday( &now, 0 );
+	return now.tv_sec + now.tv_usec / 1e6;
+}
+
+// while kernel has untried candidates, times this run with the next one and settles on the fastest after the last
+void TCRIteratorCPU::RunTuned( void* (*job)( void* ), KernelChunks& kernel )
+{
+	int trial = kernel.seconds.size();
+	if( trial >= (int)kernel.candidates.size() )
+	{
+		kernel.last = kernel.chunks;
+		RunChunks( job, kernel.chunks );
+		return;
+	}
+
+	kernel.last = kernel.candidates[trial];
+	double start = Seconds();
+	RunChunks( job, kernel.last );
+	kernel.seconds.push_back( Seconds() - start );
+
+	if( trial + 1 == (int)kernel.candidates.size() )
+	{
+		int best = std::min_element( kernel.seconds.begin(), kernel.seconds.end() ) - kernel.seconds.begin();
+		kernel.chunks = kernel.candidates[best];
+		std::stringstream timings;
+		for( int i = 0; i < (int)kernel.candidates.size(); i++ )
+			timings << " " << kernel.candidates[i] << ":" << kernel.seconds[i] * 1000 << "ms";
+		GIRLogger::LogInfo( "TCRIteratorCPU::RunTuned -> %s chunks%s, using %d\n", kernel.name, timings.str().c_str(), kernel.chunks );
+	}
+}
+
+// element boundaries of the chunks, chunk i covers the same images GetImageRange gives it in the kernels
+std::vector<long> TCRIteratorCPU::ImageBounds( int images, long elements_per_image )
+{
+	std::vector<long> bounds( num_threads + 1 );
+	int images_per_thread = (int)ceil( (float)images / num_threads );
+	for( int i = 0; i <= num_threads; i++ )
+		bounds[i] = std::min( i * images_per_thread, images ) * elements_per_image;
+	return bounds;
+}
+
+struct FirstTouchArgs
+{
+	char* start;
+	size_t bytes;
+};
+
+static void* FirstTouchChunk( void* args_ptr )
+{
+	FirstTouchArgs* args = (FirstTouchArgs*) args_ptr;
+	memset( args->start, 0, args->bytes );
+	return 0;
+}
+
+// zeroes chunk i of buffer from the worker that runs chunk i, the pages it faults in are placed on that worker's node
+void TCRIteratorCPU::FirstTouch( void* buffer, size_t element_size, const std::vector<long>& bounds )
+{
+	std::vector<FirstTouchArgs> touch_args( bounds.size() - 1 );
+	for( int i = 0; i < (int)touch_args.size(); i++ )
+	{
+		touch_args[i].start = (char*)buffer + bounds[i] * element_size;
+		touch_args[i].bytes = ( bounds[i+1] - bounds[i] ) * element_size;
+	}
+	thread_pool->RunStatic( FirstTouchChunk, touch_args );
+}
+
+struct TemporalTouchArgs
+{
+	float* buffer;
+	int first_unit;
+	int last_unit;
+	int blocks_per_image;
+	int image_size;
+	int frames;
+};
+
+static void* TemporalTouchChunk( void* args_ptr )
+{
+	TemporalTouchArgs* args = (TemporalTouchArgs*) args_ptr;
+	for( int unit = args->first_unit; unit < args->last_unit; unit++ )
+	{
+		int group = unit / args->blocks_per_image;
+		int start = ( unit % args->blocks_per_image ) * TCR_TV_BLOCK;
+		int length = std::min( args->image_size - start, TCR_TV_BLOCK );
+		for( int t = 0; t < args->frames; t++ )
+			memset( args->buffer + 2L * ( ( (long)group * args->frames + t ) * args->image_size + start ), 0, sizeof( float ) * 2 * length );
+	}
+	return 0;
+}
+
+// places an estimate sized buffer for the temporal gradient, the bandwidth bound kernel, the fidelity term does enough
+// work per image not to mind, with at least a group of frames per chunk the image chunks cover about the same memory,
+// with fewer groups every temporal chunk holds pixel blocks of all frames, so its blocks are touched frame by frame
+void TCRIteratorCPU::PlaceEstimateBuffer( float* buffer, int images, int image_size )
+{
+	int groups = images / temp_dim_size;
+	if( groups >= num_threads )
+	{
+		FirstTouch( buffer, sizeof( float ), ImageBounds( images, 2L * image_size ) );
+		return;
+	}
+
+	// the same units per chunk as CPU_CalcTemporalGradient
+	int blocks_per_image = ( image_size + TCR_TV_BLOCK - 1 ) / TCR_TV_BLOCK;
+	int total_units = groups * blocks_per_image;
+	int units_per_thread = (int)ceil( (float)total_units / num_threads );
+	std::vector<TemporalTouchArgs> touch_args( num_threads );
+	for( int i = 0; i < num_threads; i++ )
+	{
+		touch_args[i].buffer = buffer;
+		touch_args[i].first_unit = std::min( i * units_per_thread, total_units );
+		touch_args[i].last_unit = std::min( ( i + 1 ) * units_per_thread, total_units );
+		touch_args[i].blocks_per_image = blocks_per_image;
+		touch_args[i].image_size = image_size;
+		touch_args[i].frames = temp_dim_size;
+	}
+	thread_pool->RunStatic( TemporalTouchChunk, touch_args );
+}
+
+bool TCRIteratorCPU::LoadToeplitz( MRIData& src_kernel )
+{
+	if( gradient == 0 )
+	{
+		GIRLogger::LogError( "TCRIteratorCPU::LoadToeplitz -> nothing loaded yet, aborting!\n" );
+		return false;
+	}
+
+	// one kernel per temporal index, the frames are the only thing besides the 2D image in it
+	const MRIDimensions& data_size = args[0].data_size;
+	const MRIDimensions& kernel_size = src_kernel.Size();
+	int kernel_frames = ( temp_dim == TEMP_DIM_REP )? kernel_size.Repetition: kernel_size.Phase;
+	int padded_size = 4 * args[0].image_size;
+	if( !src_kernel.IsComplex() || kernel_size.Column != 2 * data_size.Column || kernel_size.Line != 2 * data_size.Line || kernel_frames != temp_dim_size || src_kernel.NumPixels() != padded_size * temp_dim_size )
+	{
+		GIRLogger::LogError( "TCRIteratorCPU::LoadToeplitz -> kernel %s doesn't fit data %s, aborting!\n", kernel_size.ToString().c_str(), data_size.ToString().c_str() );
+		return false;
+	}
+
+	if( toeplitz_kernel != 0 ) delete[] toeplitz_kernel;
+	toeplitz_kernel = new float[src_kernel.NumElements()];
+	memcpy( toeplitz_kernel, src_kernel.GetDataStart(), sizeof( float ) * src_kernel.NumElements() );
+
+	if( toeplitz_buffers != 0 ) delete[] toeplitz_buffers;
+	toeplitz_buffers = new float[2L * padded_size * num_threads];
+
+	// the normal operator takes the whole gridded image, scatter the samples back into it
+	if( meas_data == 0 )
+	{
+		int meas_images = meas_pixels / args[0].image_size;
+		int est_images = args[0].num_pixels / args[0].image_size;
+		meas_data = new float[2L * meas_pixels];
+		if( pin_threads )
+			FirstTouch( meas_data, sizeof( float ), ImageBounds( est_images, 2L * args[0].image_size * ( meas_images / est_images ) ) );
+		else
+			memset( meas_data, 0, sizeof( float ) * 2L * meas_pixels );
+		for( int i = 0; i < meas_images; i++ )
+		{
+			float* image = meas_data + 2L * i * args[0].image_size;
+			for( int k = sample_offsets[i]; k < sample_offsets[i+1]; k++ )
+			{
+				image[2*sample_index[k]] = sample_values[2*k];
+				image[2*sample_index[k]+1] = sample_values[2*k+1];
+			}
+		}
+
+		// the gridded image is nearly all samples, keeping them as well would take more than the image itself
+		delete [] sample_offsets; sample_offsets = 0;
+		delete [] sample_index; sample_index = 0;
+		delete [] sample_values; sample_values = 0;
+	}
+
+	for( int i = 0; i < num_threads; i++ )
+	{
+		args[i].toeplitz_kernel = toeplitz_kernel;
+		args[i].toeplitz_buffer = toeplitz_buffers + 2L * padded_size * i;
+		args[i].meas_data = meas_data;
+		args[i].sample_offsets = 0;
+		args[i].sample_index = 0;
+		args[i].sample_values = 0;
+	}
+
+	use_toeplitz = true;
+	return true;
 }
 
 void TCRIteratorCPU::Unload( MRIData& dest_estimate )
 {
 	if( estimate == 0 )
 		GIRLogger::LogError( "TCRIteratorCPU::Unload -> estimate == 0, unload aborting!\n" );
+	// nesterov's estimate is the extrapolated point, the result is the last gradient step from it
+	else if( solver == SOLVER_NESTEROV && previous_estimate != 0 )
+		Unorder( dest_estimate, previous_estimate );
 	else
 		Unorder( dest_estimate, estimate );
 }
 
-void TCRIteratorCPU::ApplySensitivity()
+void TCRIteratorCPU::ApplyFidelity()
 {
-	// create threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_create( &pthreads[i], NULL, CPU_ApplySensitivity, (void*)(&args[i]) );
-	// join threads
+	if( gradient_current )
+		return;
+
+	// every (channel, frame) image goes through the whole chain while it's in cache, the line search always needs the cost
 	for( int i = 0; i < num_threads; i++ )
-		pthread_join( pthreads[i], NULL );
+		args[i].calc_cost = ( calc_cost || solver == SOLVER_CONJUGATE_GRADIENT );
+	RunTuned( CPU_ApplyFidelity, image_chunks );
+}
+
+void TCRIteratorCPU::ApplySensitivity()
+{
+	RunChunks( CPU_ApplySensitivity, vector_chunks );
 }
 
 void TCRIteratorCPU::ApplyInvSensitivity() 
 {
-	// create threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_create( &pthreads[i], NULL, CPU_ApplyInvSensitivity, (void*)(&args[i]) );
-	// join threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_join( pthreads[i], NULL );
+	RunChunks( CPU_ApplyInvSensitivity, vector_chunks );
 }
 
 void TCRIteratorCPU::FFT() 
 {
-	// create threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_create( &pthreads[i], NULL, CPU_FFT, (void*)(&args[i]) );
-	// join threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_join( pthreads[i], NULL );
+	RunChunks( CPU_FFT, image_chunks.chunks );
 }
 
 void TCRIteratorCPU::IFFT() 
 {
-	// create threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_create( &pthreads[i], NULL, CPU_IFFT, (void*)(&args[i]) );
-	// join threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_join( pthreads[i], NULL );
+	RunChunks( CPU_IFFT, image_chunks.chunks );
 }
 
 void TCRIteratorCPU::ApplyFidelityDifference()
 {
-	// create threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_create( &pthreads[i], NULL, CPU_ApplyFidelityDifference, (void*)(&args[i]) );
-	// join threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_join( pthreads[i], NULL );
+	RunChunks( CPU_ApplyFidelityDifference, image_chunks.chunks );
+}
+
+void TCRIteratorCPU::ApplyNormalOperator()
+{
+	RunChunks( CPU_ApplyNormalOperator, image_chunks.chunks );
 }
 
 void TCRIteratorCPU::CalcTemporalGradient()
 {
-	// create threads
-	for( int i = 0; i < num_threads; i++ )
-		pthread_create( &pthreads[i], NULL, CPU_CalcTemporalGradient, (void*)(&args[i]) );
-	// join threads
+	if( gradient_current )
+		return;
+
 	for( int i = 0; i < num_threads; i++ )
-		pthread_join( pthreads[i], NULL );
+		args[i].calc_cost = ( calc_cost || solver == SOLVER_CONJUGATE_GRADIENT );
+	RunTuned( CPU_CalcTemporalGradient, temporal_chunks );
 }
 
 void TCRIteratorCPU::UpdateEstimate()
 {
-	// create threads
+	if( solver == SOLVER_NESTEROV )
+		NesterovStep();
+	else if( solver == SOLVER_BARZILAI_BORWEIN )
+		BarzilaiBorweinStep();
+	else if( solver == SOLVER_CONJUGATE_GRADIENT )
+		ConjugateGradientStep();
+	else
+		RunChunks( CPU_UpdateEstimate, vector_chunks );
+}
+
+void TCRIteratorCPU::NesterovStep()
+{
+	// the first gradient step starts from the loaded estimate
+	if( previous_estimate == 0 )
+	{
+		previous_estimate = NewSolverBuffer( estimate );
+		SetSolverArgs();
+	}
+
+	double next_t = ( 1 + sqrt( 1 + 4 * nesterov_t * nesterov_t ) ) / 2;
+	float momentum = (float)( ( nesterov_t - 1 ) / next_t );
+	nesterov_t = next_t;
+
 	for( int i = 0; i < num_threads; i++ )
-		pthread_create( &pthreads[i], NULL, CPU_UpdateEstimate, (void*)(&args[i]) );
-	// join threads
+		args[i].momentum = momentum;
+	RunChunks( CPU_NesterovUpdate, vector_chunks );
+}
+
+void TCRIteratorCPU::BarzilaiBorweinStep()
+{
+	// step_size until there is a previous step to take the curvature from
+	float step = args[0].step_size;
+	if( previous_estimate == 0 )
+	{
+		previous_estimate = NewSolverBuffer( 0 );
+		previous_gradient = NewSolverBuffer( 0 );
+		SetSolverArgs();
+	}
+	else
+	{
+		double dots[3];
+		RunChunks( CPU_BarzilaiBorweinDots, vector_chunks );
+		SumDots( dots );
+		if( dots[1] > 0 )
+			step = (float)( dots[1] / dots[2] );
+		else
+			GIRLogger::LogDebug( "TCRIteratorCPU::BarzilaiBorweinStep -> non-positive curvature, using step_size\n" );
+	}
+	GIRLogger::LogDebug( "TCRIteratorCPU::BarzilaiBorweinStep -> step: %g\n", step );
+
 	for( int i = 0; i < num_threads; i++ )
-		pthread_join( pthreads[i], NULL );
+		args[i].solver_step = step;
+	RunChunks( CPU_BarzilaiBorweinUpdate, vector_chunks );
+}
+
+void TCRIteratorCPU::ConjugateGradientStep()
+{
+	if( direction == 0 )
+	{
+		previous_gradient = NewSolverBuffer( 0 );
+		direction = NewSolverBuffer( 0 );
+		trial_estimate = NewSolverBuffer( 0 );
+		trial_gradient = NewSolverBuffer( 0 );
+		SetSolverArgs();
+		restart_direction = true;
+	}
+
+	// the chunk sums still hold the cost of the current estimate, either from this iteration or the accepted trial
+	double fidelity, regularizer, dots[3];
+	GetCost( fidelity, regularizer );
+	double cost = fidelity + regularizer;
+
+	// polak-ribiere coefficient, clamped at 0 so a bad direction restarts from steepest descent
+	double momentum = 0;
+	if( !restart_direction )
+	{
+		RunChunks( CPU_ConjugateGradientDots, vector_chunks );
+		SumDots( dots );
+		if( dots[2] > 0 )
+			momentum = std::max( 0.0, ( dots[0] - dots[1] ) / dots[2] );
+	}
+	for( int i = 0; i < num_threads; i++ )
+		args[i].momentum = (float)momentum;
+	RunChunks( CPU_ConjugateDirection, vector_chunks );
+	SumDots( dots );
+	double slope = dots[0];
+	if( slope >= 0 )
+	{
+		for( int i = 0; i < num_threads; i++ )
+			args[i].momentum = 0;
+		RunChunks( CPU_ConjugateDirection, vector_chunks );
+		SumDots( dots );
+		slope = dots[0];
+	}
+
+	// backtracking line search, every trial computes its gradient so the accepted one is ready for the next iteration
+	float step = line_step;
+	bool accepted = false;
+	for( int trial = 0; trial < TCR_MAX_BACKTRACKS && !accepted; trial++ )
+	{
+		for( int i = 0; i < num_threads; i++ )
+			args[i].solver_step = step;
+		RunChunks( CPU_LineSearchPoint, vector_chunks );
+
+		for( int i = 0; i < num_threads; i++ )
+		{
+			args[i].estimate = trial_estimate;
+			args[i].gradient = trial_gradient;
+			args[i].calc_cost = true;
+		}
+		CalcTrialGradient();
+		SetSolverArgs();
+
+		GetCost( fidelity, regularizer );
+		if( fidelity + regularizer <= cost + TCR_ARMIJO_FACTOR * step * slope )
+			accepted = true;
+		else
+			step *= 0.5f;
+	}
+
+	if( accepted )
+	{
+		std::swap( estimate, trial_estimate );
+		std::swap( gradient, trial_gradient );
+		SetSolverArgs();
+		gradient_current = true;
+		restart_direction = false;
+		line_step = 2 * step;
+	}
+	else
+	{
+		GIRLogger::LogError( "TCRIteratorCPU::ConjugateGradientStep -> line search found no decrease, restarting from steepest descent!\n" );
+		gradient_current = false;
+		restart_direction = true;
+		line_step = args[0].step_size;
+	}
+}
+
+// a new buffer the size of the estimate, copied from source if given
+float* TCRIteratorCPU::NewSolverBuffer( const float* source )
+{
+	long num_elements = 2L * args[0].num_pixels;
+	float* buffer = new float[num_elements];
+	if( pin_threads )
+		PlaceEstimateBuffer( buffer, args[0].num_pixels / args[0].image_size, args[0].image_size );
+	if( source != 0 )
+		memcpy( buffer, source, sizeof( float ) * num_elements );
+	return buffer;
+}
+
+void TCRIteratorCPU::FreeMeasData()
+{
+	if( meas_data != 0 ) { delete [] meas_data; meas_data = 0; }
+	if( sample_offsets != 0 ) { delete [] sample_offsets; sample_offsets = 0; }
+	if( sample_index != 0 ) { delete [] sample_index; sample_index = 0; }
+	if( sample_values != 0 ) { delete [] sample_values; sample_values = 0; }
+}
+
+void TCRIteratorCPU::FreeSolverBuffers()
+{
+	if( previous_estimate != 0 ) { delete [] previous_estimate; previous_estimate = 0; }
+	if( previous_gradient != 0 ) { delete [] previous_gradient; previous_gradient = 0; }
+	if( direction != 0 ) { delete [] direction; direction = 0; }
+	if( trial_estimate != 0 ) { delete [] trial_estimate; trial_estimate = 0; }
+	if( trial_gradient != 0 ) { delete [] trial_gradient; trial_gradient = 0; }
+}
+
+void TCRIteratorCPU::SetSolverArgs()
+{
+	for( int i = 0; i < num_threads; i++ )
+	{
+		args[i].estimate = estimate;
+		args[i].gradient = gradient;
+		args[i].previous_estimate = previous_estimate;
+		args[i].previous_gradient = previous_gradient;
+		args[i].direction = direction;
+		args[i].trial_estimate = trial_estimate;
+	}
+}
+
+// fidelity and temporal gradient (and cost) at the trial estimate for the line search
+void TCRIteratorCPU::CalcTrialGradient()
+{
+	RunTuned( CPU_ApplyFidelity, image_chunks );
+	RunTuned( CPU_CalcTemporalGradient, temporal_chunks );
+}
+
+// sums the chunks in order so the result doesn't depend on which thread ran what
+void TCRIteratorCPU::SumDots( double* dots )
+{
+	dots[0] = dots[1] = dots[2] = 0;
+	for( int i = 0; i < vector_chunks; i++ )
+		for( int j = 0; j < 3; j++ )
+			dots[j] += args[i].dot_products[j];
+}
+
+bool TCRIteratorCPU::GetCost( double& fidelity, double& regularizer )
+{
+	// sum the chunks in order so the result doesn't depend on which thread ran what
+	fidelity = 0;
+	regularizer = 0;
+	for( int i = 0; i < image_chunks.last; i++ )
+		fidelity += args[i].fidelity_cost;
+	for( int i = 0; i < temporal_chunks.last; i++ )
+		regularizer += args[i].regularizer_cost;
+	return true;
 }
 /*
 void Plugin_TCR::GenOrigEstimate() 
@@ -5,49 +5,142 @@
 #include <MRIData.h>
 #include <GIRLogger.h>
 #include <KernelCode.h>
+#include <ThreadPool.h>
 #include <vector>
-#include <pthread.h>
 
 class TCRIteratorCPU: public TCRIterator
 {
 	public:
 	TCRIteratorCPU( int new_num_threads, TemporalDimension new_temp_dim ): 
 		meas_data( 0 ), 
+		sample_offsets( 0 ),
+		sample_index( 0 ),
+		sample_values( 0 ),
+		meas_pixels( 0 ),
 		gradient( 0 ),
 		estimate( 0 ), 
 		coil_map( 0 ), 
 		lambda_map( 0 ),
-		num_threads( new_num_threads ), 
-		args( new_num_threads ),
-		pthreads( new_num_threads ),
+		toeplitz_kernel( 0 ),
+		toeplitz_buffers( 0 ),
+		scratch_images( 0 ),
+		previous_estimate( 0 ),
+		previous_gradient( 0 ),
+		direction( 0 ),
+		trial_estimate( 0 ),
+		trial_gradient( 0 ),
+		gradient_current( false ),
+		restart_direction( true ),
+		nesterov_t( 1 ),
+		line_step( 0 ),
+		pin_threads( false ),
+		auto_chunks( new_num_threads < 1 ),
+		calibrate( false ),
+		num_threads( ( new_num_threads > 0 )? new_num_threads: 0 ), 
+		args( ( new_num_threads > 0 )? new_num_threads: 0 ),
+		thread_pool( ThreadPool::Instance() ),
 		TCRIterator( new_temp_dim )
 	{
-		GIRLogger::LogInfo( "TCRIteratorCPU::TCRIteratorCPU -> initializing with %d CPU threads...\n", new_num_threads );
+		if( auto_chunks )
+			GIRLogger::LogInfo( "TCRIteratorCPU::TCRIteratorCPU -> initializing with automatic CPU work chunks on %d threads...\n", thread_pool->NumThreads() );
+		else
+			GIRLogger::LogInfo( "TCRIteratorCPU::TCRIteratorCPU -> initializing with %d CPU work chunks on %d threads...\n", new_num_threads, thread_pool->NumThreads() );
 	}
 
 	~TCRIteratorCPU();
 
 	virtual void Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& src_estimate, MRIData& src_coil_map, MRIData& src_lambda_map );
 	virtual void Unload( MRIData& dest_estimate );
+	virtual bool LoadToeplitz( MRIData& src_kernel );
+	virtual bool SetSolver( Solver new_solver );
+	// before Load, pins the pool's workers, always runs chunk i on the same worker and has that worker first touch
+	// chunk i's part of the big arrays so on NUMA machines they end up on its node, the measurements are placed for
+	// the fidelity term and the estimate sized buffers for the temporal gradient
+	bool SetThreadPinning( bool new_pin_threads );
+	// before Load, times the image and temporal kernels with a few chunk counts on the first iterations and keeps the
+	// fastest, the iterations themselves are unaffected
+	void SetCalibration( bool new_calibrate ) { calibrate = new_calibrate; }
 
 	protected:
+	virtual void ApplyFidelity();
 	virtual void ApplySensitivity();
 	virtual void ApplyInvSensitivity();
 	virtual void FFT();
 	virtual void IFFT();
 	virtual void ApplyFidelityDifference();
+	virtual void ApplyNormalOperator();
 	virtual void CalcTemporalGradient();
 	virtual void UpdateEstimate();
+	virtual bool GetCost( double& fidelity, double& regularizer );
+	virtual float* CheckpointEstimate( long& length );
+	virtual void ResetSolverState();
+	// fidelity and temporal gradient with their cost for the estimate the args currently point to, used by the line search
+	virtual void CalcTrialGradient();
+	virtual void SumDots( double* dots );
 
-	private:
+	// chunk count of one kind of kernel, candidates are tried once each while calibrating
+	struct KernelChunks
+	{
+		const char* name;
+		int chunks;
+		int last;
+		std::vector<int> candidates;
+		std::vector<double> seconds;
+	};
+
+	void NesterovStep();
+	void BarzilaiBorweinStep();
+	void ConjugateGradientStep();
+	float* NewSolverBuffer( const float* source );
+	void FreeSolverBuffers();
+	void SetSolverArgs();
+	void FreeMeasData();
+	void RunChunks( void* (*job)( void* ), int chunks );
+	void RunTuned( void* (*job)( void* ), KernelChunks& kernel );
+	void SetChunks( KernelChunks& kernel, const char* name, int work_units );
+	std::vector<long> ImageBounds( int images, long elements_per_image );
+	void FirstTouch( void* buffer, size_t element_size, const std::vector<long>& bounds );
+	void PlaceEstimateBuffer( float* buffer, int images, int image_size );
+
+	// dense measurements only for the toeplitz normal operator, the cartesian fidelity term uses the sampled locations
 	float* meas_data;
+	int* sample_offsets;
+	int* sample_index;
+	float* sample_values;
+	int meas_pixels;
 	float* gradient;
 	float* estimate;
 	float* coil_map;
 	float* lambda_map;
+	float* toeplitz_kernel;
+	// one padded image per thread
+	float* toeplitz_buffers;
+	// one image per thread for adding up the channels of a coil combined estimate
+	float* scratch_images;
+	// solver state, each buffer is the size of the estimate and only allocated by the solvers that need it
+	float* previous_estimate;
+	float* previous_gradient;
+	float* direction;
+	float* trial_estimate;
+	float* trial_gradient;
+	// the line search already left the gradient and cost of the current estimate behind
+	bool gradient_current;
+	bool restart_direction;
+	double nesterov_t;
+	float line_step;
+	bool pin_threads;
+	// the "threads" count given was < 1, so the chunk counts come from the pool size and the data
+	bool auto_chunks;
+	bool calibrate;
+	KernelChunks image_chunks;
+	KernelChunks temporal_chunks;
+	// elementwise kernels are bandwidth bound, one contiguous range per worker
+	int vector_chunks;
+	// number of args, the most chunks any kernel runs with
 	int num_threads;
 	std::vector<KernelArgs> args;
-	std::vector<pthread_t> pthreads;
+	// the shared pool, every step hands it one job per chunk and waits for all of them before the next step
+	ThreadPool* thread_pool;
 };
 
 #endif
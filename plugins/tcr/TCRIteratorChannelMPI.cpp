@@ -0,0 +1,85 @@
+#include <TCRIteratorChannelMPI.h>
+#include <GIRLogger.h>
+#include <cstdlib>
+
+TCRIteratorChannelMPI::TCRIteratorChannelMPI( int new_num_threads, TemporalDimension new_temp_dim, MPI_Comm new_comm ):
+	TCRIteratorCPU( new_num_threads, new_temp_dim ),
+	comm( new_comm )
+{
+	MPI_Comm_rank( comm, &rank );
+}
+
+void TCRIteratorChannelMPI::Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& src_estimate, MRIData& src_coil_map, MRIData& src_lambda_map )
+{
+	TCRIteratorCPU::Load( alpha, beta, beta_squared, step_size, src_meas_data, src_estimate, src_coil_map, src_lambda_map );
+
+	// every rank has to hold the same combined estimate, a rank with a single channel iterates on it the same way
+	int pixels = ( args.empty() || src_estimate.Size().Channel != 1 )? 0: args[0].num_pixels;
+	int min_pixels;
+	int max_pixels;
+	MPI_Allreduce( &pixels, &min_pixels, 1, MPI_INT, MPI_MIN, comm );
+	MPI_Allreduce( &pixels, &max_pixels, 1, MPI_INT, MPI_MAX, comm );
+	if( min_pixels != max_pixels || pixels == 0 )
+	{
+		GIRLogger::LogError( "TCRIteratorChannelMPI::Load -> rank %d's estimate %s isn't the coil combined one of the others, aborting!\n", rank, src_estimate.Size().ToString().c_str() );
+		MPI_Abort( comm, EXIT_FAILURE );
+	}
+	GIRLogger::LogInfo( "TCRIteratorChannelMPI::Load -> rank %d summing %d channels into the combined estimate...\n", rank, src_meas_data.Size().Channel );
+}
+
+int TCRIteratorChannelMPI::Resume()
+{
+	// ranks resuming from different iterations would run different numbers of collective steps
+	TCRIterator::Resume();
+	int min_iteration;
+	int max_iteration;
+	MPI_Allreduce( &start_iteration, &min_iteration, 1, MPI_INT, MPI_MIN, comm );
+	MPI_Allreduce( &start_iteration, &max_iteration, 1, MPI_INT, MPI_MAX, comm );
+	if( min_iteration != max_iteration )
+	{
+		GIRLogger::LogError( "TCRIteratorChannelMPI::Resume -> checkpoints of the ranks cover %d to %d iterations, iterating from the start!\n", min_iteration, max_iteration );
+		start_iteration = 0;
+	}
+	return start_iteration;
+}
+
+void TCRIteratorChannelMPI::ApplyFidelity()
+{
+	bool fresh = !gradient_current;
+	TCRIteratorCPU::ApplyFidelity();
+	if( fresh )
+		ReduceGradient();
+}
+
+void TCRIteratorChannelMPI::CalcTrialGradient()
+{
+	RunTuned( CPU_ApplyFidelity, image_chunks );
+	ReduceGradient();
+	RunTuned( CPU_CalcTemporalGradient, temporal_chunks );
+}
+
+// summed on rank 0 and broadcast, an allreduce may round differently on different ranks and their copies of the
+// estimate, and with them the solvers' decisions, have to stay identical
+void TCRIteratorChannelMPI::ReduceGradient()
+{
+	int length = 2 * args[0].num_pixels;
+	MPI_Reduce( ( rank == 0 )? MPI_IN_PLACE: args[0].gradient, args[0].gradient, length, MPI_FLOAT, MPI_SUM, 0, comm );
+	MPI_Bcast( args[0].gradient, length, MPI_FLOAT, 0, comm );
+}
+
+bool TCRIteratorChannelMPI::GetCost( double& fidelity, double& regularizer )
+{
+	// the regularizer is the same everywhere, the fidelity term is summed over the channels
+	TCRIteratorCPU::GetCost( fidelity, regularizer );
+	MPI_Reduce( ( rank == 0 )? MPI_IN_PLACE: &fidelity, &fidelity, 1, MPI_DOUBLE, MPI_SUM, 0, comm );
+	MPI_Bcast( &fidelity, 1, MPI_DOUBLE, 0, comm );
+	return true;
+}
+
+bool TCRIteratorChannelMPI::SharedStop( bool stop )
+{
+	int local_stop = ( stop )? 1: 0;
+	int any_stop;
+	MPI_Allreduce( &local_stop, &any_stop, 1, MPI_INT, MPI_MAX, comm );
+	return any_stop != 0;
+}
@@ -0,0 +1,32 @@
+#ifndef TCR_ITERATOR_CHANNEL_MPI_H
+#define TCR_ITERATOR_CHANNEL_MPI_H
+
+#include <TCRIteratorCPU.h>
+#include <mpi.h>
+
+// one part of a reconstruction split over channels, every process of comm loads the same frames of a disjoint range
+// of channels and the same coil combined estimate, the fidelity gradients and costs of the channels are summed over
+// them so every process steps its copy of the estimate the same way a single iterator on all channels would, Load,
+// Iterate, Resume and Unload have to be called on all of them
+class TCRIteratorChannelMPI: public TCRIteratorCPU
+{
+	public:
+	TCRIteratorChannelMPI( int new_num_threads, TemporalDimension new_temp_dim, MPI_Comm new_comm );
+
+	virtual void Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& src_estimate, MRIData& src_coil_map, MRIData& src_lambda_map );
+	virtual int Resume();
+
+	protected:
+	virtual void ApplyFidelity();
+	virtual void CalcTrialGradient();
+	virtual bool GetCost( double& fidelity, double& regularizer );
+	virtual bool SharedStop( bool stop );
+
+	// adds up the channels' parts of the fidelity gradient the args point to
+	void ReduceGradient();
+
+	MPI_Comm comm;
+	int rank;
+};
+
+#endif
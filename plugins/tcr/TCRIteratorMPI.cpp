@@ -0,0 +1,160 @@
+#include <TCRIteratorMPI.h>
+#include <GIRLogger.h>
+#include <cstdlib>
+
+TCRIteratorMPI::TCRIteratorMPI( int new_num_threads, TemporalDimension new_temp_dim, MPI_Comm new_comm ):
+	TCRIteratorCPU( new_num_threads, new_temp_dim ),
+	comm( new_comm ),
+	frame_type_committed( false ),
+	halo_previous( 0 ),
+	halo_next( 0 ),
+	halos_posted( false )
+{
+	int ranks;
+	MPI_Comm_rank( comm, &rank );
+	MPI_Comm_size( comm, &ranks );
+
+	// the last rank's next frames are the first rank's, closing the periodic boundary of the whole series
+	previous_rank = ( rank + ranks - 1 ) % ranks;
+	next_rank = ( rank + 1 ) % ranks;
+}
+
+TCRIteratorMPI::~TCRIteratorMPI()
+{
+	WaitHalos();
+	FreeHalos();
+}
+
+void TCRIteratorMPI::Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& src_estimate, MRIData& src_coil_map, MRIData& src_lambda_map )
+{
+	WaitHalos();
+	TCRIteratorCPU::Load( alpha, beta, beta_squared, step_size, src_meas_data, src_estimate, src_coil_map, src_lambda_map );
+
+	// every rank has to exchange frames of the same size
+	int image_size = args[0].image_size;
+	int groups = args[0].num_pixels / ( image_size * temp_dim_size );
+	int frame_length = 2 * image_size * groups;
+	int min_length;
+	int max_length;
+	MPI_Allreduce( &frame_length, &min_length, 1, MPI_INT, MPI_MIN, comm );
+	MPI_Allreduce( &frame_length, &max_length, 1, MPI_INT, MPI_MAX, comm );
+	if( min_length != max_length || temp_dim_size < 1 )
+	{
+		GIRLogger::LogError( "TCRIteratorMPI::Load -> rank %d has %d frames of %d floats, ranks need at least one frame of the same size, aborting!\n", rank, temp_dim_size, frame_length );
+		MPI_Abort( comm, EXIT_FAILURE );
+	}
+
+	FreeHalos();
+	halo_previous = new float[frame_length];
+	halo_next = new float[frame_length];
+	MPI_Type_vector( groups, 2 * image_size, 2 * image_size * temp_dim_size, MPI_FLOAT, &frame_type );
+	MPI_Type_commit( &frame_type );
+	frame_type_committed = true;
+
+	for( int i = 0; i < num_threads; i++ )
+	{
+		args[i].halo_previous = halo_previous;
+		args[i].halo_next = halo_next;
+	}
+	GIRLogger::LogInfo( "TCRIteratorMPI::Load -> rank %d iterating on %d frames, halos from ranks %d and %d...\n", rank, temp_dim_size, previous_rank, next_rank );
+}
+
+int TCRIteratorMPI::Resume()
+{
+	// ranks resuming from different iterations would run different numbers of collective steps
+	TCRIterator::Resume();
+	int min_iteration;
+	int max_iteration;
+	MPI_Allreduce( &start_iteration, &min_iteration, 1, MPI_INT, MPI_MIN, comm );
+	MPI_Allreduce( &start_iteration, &max_iteration, 1, MPI_INT, MPI_MAX, comm );
+	if( min_iteration != max_iteration )
+	{
+		GIRLogger::LogError( "TCRIteratorMPI::Resume -> checkpoints of the ranks cover %d to %d iterations, iterating from the start!\n", min_iteration, max_iteration );
+		start_iteration = 0;
+	}
+	return start_iteration;
+}
+
+void TCRIteratorMPI::ApplyFidelity()
+{
+	// the border frames travel while the fidelity term, which only needs the frames here, runs
+	if( !gradient_current )
+		PostHalos();
+	TCRIteratorCPU::ApplyFidelity();
+}
+
+void TCRIteratorMPI::CalcTemporalGradient()
+{
+	WaitHalos();
+	TCRIteratorCPU::CalcTemporalGradient();
+}
+
+void TCRIteratorMPI::CalcTrialGradient()
+{
+	PostHalos();
+	RunTuned( CPU_ApplyFidelity, image_chunks );
+	WaitHalos();
+	RunTuned( CPU_CalcTemporalGradient, temporal_chunks );
+}
+
+void TCRIteratorMPI::SumDots( double* dots )
+{
+	double local_dots[3];
+	TCRIteratorCPU::SumDots( local_dots );
+	MPI_Allreduce( local_dots, dots, 3, MPI_DOUBLE, MPI_SUM, comm );
+}
+
+bool TCRIteratorMPI::GetCost( double& fidelity, double& regularizer )
+{
+	double local_cost[2];
+	double cost[2];
+	TCRIteratorCPU::GetCost( local_cost[0], local_cost[1] );
+	MPI_Allreduce( local_cost, cost, 2, MPI_DOUBLE, MPI_SUM, comm );
+	fidelity = cost[0];
+	regularizer = cost[1];
+	return true;
+}
+
+bool TCRIteratorMPI::SharedStop( bool stop )
+{
+	int local_stop = ( stop )? 1: 0;
+	int any_stop;
+	MPI_Allreduce( &local_stop, &any_stop, 1, MPI_INT, MPI_MAX, comm );
+	return any_stop != 0;
+}
+
+// sends the first and last frame of every group of the estimate the args point to straight from it and receives the
+// neighbours' into the halos, the estimate must not change until WaitHalos
+void TCRIteratorMPI::PostHalos()
+{
+	if( halos_posted || halo_previous == 0 )
+		return;
+
+	int frame_length = 2 * args[0].image_size * ( args[0].num_pixels / ( args[0].image_size * temp_dim_size ) );
+	float* first_frame = args[0].estimate;
+	float* last_frame = args[0].estimate + 2L * ( temp_dim_size - 1 ) * args[0].image_size;
+	MPI_Irecv( halo_previous, frame_length, MPI_FLOAT, previous_rank, TCR_HALO_FORWARD_TAG, comm, &halo_requests[0] );
+	MPI_Irecv( halo_next, frame_length, MPI_FLOAT, next_rank, TCR_HALO_BACKWARD_TAG, comm, &halo_requests[1] );
+	MPI_Isend( last_frame, 1, frame_type, next_rank, TCR_HALO_FORWARD_TAG, comm, &halo_requests[2] );
+	MPI_Isend( first_frame, 1, frame_type, previous_rank, TCR_HALO_BACKWARD_TAG, comm, &halo_requests[3] );
+	halos_posted = true;
+}
+
+void TCRIteratorMPI::WaitHalos()
+{
+	if( !halos_posted )
+		return;
+	MPI_Waitall( 4, halo_requests, MPI_STATUSES_IGNORE );
+	halos_posted = false;
+}
+
+void TCRIteratorMPI::FreeHalos()
+{
+	if( halo_previous != 0 ) { delete [] halo_previous; halo_previous = 0; }
+	if( halo_next != 0 ) { delete [] halo_next; halo_next = 0; }
+	if( frame_type_committed )
+	{
+		MPI_Type_free( &frame_type );
+		frame_type_committed = false;
+	}
+}
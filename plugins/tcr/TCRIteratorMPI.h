@@ -0,0 +1,48 @@
+#ifndef TCR_ITERATOR_MPI_H
+#define TCR_ITERATOR_MPI_H
+
+#include <TCRIteratorCPU.h>
+#include <mpi.h>
+
+// tags of the halo frames, forward goes to the next rank and backward to the previous one
+const int TCR_HALO_FORWARD_TAG = 10;
+const int TCR_HALO_BACKWARD_TAG = 11;
+
+// one part of a distributed reconstruction, every process of comm loads a disjoint range of frames in rank order and
+// the iterators exchange the frames at the borders of their ranges every iteration, so together they compute exactly
+// what a single iterator on all frames would, Load, Iterate, Resume and Unload have to be called on all of them
+class TCRIteratorMPI: public TCRIteratorCPU
+{
+	public:
+	TCRIteratorMPI( int new_num_threads, TemporalDimension new_temp_dim, MPI_Comm new_comm );
+	~TCRIteratorMPI();
+
+	virtual void Load( float alpha, float beta, float beta_squared, float step_size, MRIData& src_meas_data, MRIData& src_estimate, MRIData& src_coil_map, MRIData& src_lambda_map );
+	virtual int Resume();
+
+	protected:
+	virtual void ApplyFidelity();
+	virtual void CalcTemporalGradient();
+	virtual void CalcTrialGradient();
+	virtual void SumDots( double* dots );
+	virtual bool GetCost( double& fidelity, double& regularizer );
+	virtual bool SharedStop( bool stop );
+
+	void PostHalos();
+	void WaitHalos();
+	void FreeHalos();
+
+	MPI_Comm comm;
+	int rank;
+	int previous_rank;
+	int next_rank;
+	// the first frame of every group of frames straight out of the estimate
+	MPI_Datatype frame_type;
+	bool frame_type_committed;
+	float* halo_previous;
+	float* halo_next;
+	MPI_Request halo_requests[4];
+	bool halos_posted;
+};
+
+#endif
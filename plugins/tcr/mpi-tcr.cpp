@@ -3,6 +3,7 @@
 #include <GIRLogger.h>
 #include <MRIDataTool.h>
 #include <Serializable.h>
+#include <MRIDataComm.h>
 #include <MPITools.h>
 #include <RadialGridder.h>
 #include <MRIDataSplitter.h>
@@ -10,22 +11,124 @@
 #include <iostream>
 #include <sstream>
 #include <stdio.h>
+#include <pthread.h>
+#include <vector>
 #include <math.h>
 #include <mpi.h>
 
 #include <TCRIteratorCPU.h>
+#include <TCRIteratorMPI.h>
+#include <TCRIteratorChannelMPI.h>
 #ifndef NO_CUDA
 	#include <TCRIteratorCUDA.h>
 #endif
 
-bool Reconstruct( MRIData& data, float alpha, float beta, float step_size, int iterations, bool use_gpu, int rep_offset )
+// how the data is spread over the tasks: equal blocks along the axis MPIPartitioner picks for its shape, overlapping
+// if it's repetitions, disjoint repetitions iterated together with halo exchange, or small overlapping chunks of
+// repetitions the master hands out to whichever worker is free
+enum PartitionMode { MODE_STATIC, MODE_DISTRIBUTED, MODE_DYNAMIC };
+
+// repetitions every part carries on either side of its body, unless distributed
+#define TCR_REPETITION_OVERLAP 3
+// appended to a FileCommunicator input to name the repetition file -convert writes from it
+#define TCR_REPETITION_FILE_SUFFIX ".reps"
+// a chunk's body is at least this many times the overlap it carries on either side
+#define TCR_MIN_CHUNK_OVERLAPS 2
+// chunks per worker in dynamic mode, enough for fast workers to take over the work of slow ones
+#define TCR_CHUNKS_PER_WORKER 4
+
+// tag of the chunk index the master sends ahead of a chunk's data, -1 tells a worker to stop
+const int TCR_CHUNK_TAG = 20;
+
+// a checkpoint file per part of the data, unique however the data was split
+std::string CheckpointPath( PartitionAxis axis, int start )
+{
+	std::stringstream path;
+	path << "tcr_checkpoint.";
+	if( axis != AXIS_REPETITION )
+		path << MPIPartitioner::AxisName( axis ) << ".";
+	path << start;
+	return path.str();
+}
+
+// divides the coil images of every rank's channels by their root sum of squares over all channels of all ranks
+void NormalizeCoilMap( MRIData& coil_map, MPI_Comm comm )
+{
+	int image_size = coil_map.Size().Column * coil_map.Size().Line;
+	int channels = coil_map.Size().Channel;
+	int slices = coil_map.Size().Slice;
+	std::vector<float> sum_of_squares( (long)image_size * slices, 0 );
+	for( int slice = 0; slice < slices; slice++ )
+	for( int channel = 0; channel < channels; channel++ )
+	{
+		float* coil = coil_map.GetDataIndex( 0, 0, channel, 0, 0, slice, 0, 0, 0, 0, 0 );
+		float* sum = &sum_of_squares[(long)slice * image_size];
+		for( int i = 0; i < image_size; i++ )
+			sum[i] += coil[2*i] * coil[2*i] + coil[2*i+1] * coil[2*i+1];
+	}
+	MPI_Allreduce( MPI_IN_PLACE, &sum_of_squares[0], (int)sum_of_squares.size(), MPI_FLOAT, MPI_SUM, comm );
+
+	for( int slice = 0; slice < slices; slice++ )
+	for( int channel = 0; channel < channels; channel++ )
+	{
+		float* coil = coil_map.GetDataIndex( 0, 0, channel, 0, 0, slice, 0, 0, 0, 0, 0 );
+		float* sum = &sum_of_squares[(long)slice * image_size];
+		for( int i = 0; i < image_size; i++ )
+		{
+			float norm = (float)sqrt( sum[i] ) + 1.0e-20f;
+			coil[2*i] /= norm;
+			coil[2*i+1] /= norm;
+		}
+	}
+}
+
+// replaces estimate by its combination with the coil_map over the channels of all ranks, summed on rank 0 and
+// broadcast so every rank starts from exactly the same images
+void CombineChannels( MRIData& estimate, MRIData& coil_map, MPI_Comm comm )
+{
+	int rank;
+	MPI_Comm_rank( comm, &rank );
+	MRIData combined;
+	MRIDataTool::CoilCombine( estimate, coil_map, combined );
+	MPI_Reduce( ( rank == 0 )? MPI_IN_PLACE: combined.GetDataStart(), combined.GetDataStart(), combined.NumElements(), MPI_FLOAT, MPI_SUM, 0, comm );
+	MPI_Bcast( combined.GetDataStart(), combined.NumElements(), MPI_FLOAT, 0, comm );
+	estimate = combined;
+}
+
+// a checkpoint_interval > 0 dumps the estimate to checkpoint_path every checkpoint_interval iterations, a restarted run
+// splitting the data the same way continues from it and it is removed once the part is done, distributed has every
+// rank hold disjoint repetitions and iterate together with the others, exchanging the border frames instead of
+// overlapping, a channel axis has every rank hold disjoint channels of all frames and iterate on one coil combined
+// estimate together with the others, leaving data the combined images, the same on every rank
+bool Reconstruct( MRIData& data, float alpha, float beta, float step_size, int iterations, bool use_gpu, bool use_toeplitz, int rep_offset, int checkpoint_interval, const std::string& checkpoint_path, PartitionAxis axis, bool distributed )
 {
 	GIRLogger::LogInfo( "reconstructing (%s)...\n", data.Size().ToString().c_str() );
 	int gpu_thread_load = 2;
-	int threads = 16;
+	// chunks picked from the processors this rank may use
+	int threads = 0;
+	float beta_squared = 0.00001;
 	
 	//GIRLogger::LogDebug( "### just gridding...\n" );
 
+	// the toeplitz fidelity term needs the measurements gridded into image space without density compensation
+	// and the point spread function of every repetition, both on an accurate (Kaiser-Bessel, 2x) grid
+	MRIData adjoint_data;
+	MRIData toeplitz_kernel;
+	if( use_toeplitz )
+	{
+		RadialGridder gridder;
+		gridder.repetition_offset = rep_offset;
+		gridder.view_ordering = RadialGridder::VO_GOLDEN_RATIO;
+		gridder.oversampling = 2;
+		if( !gridder.Grid( data, adjoint_data, RadialGridder::KERN_TYPE_KAISER_BESSEL, 0, false ) || !gridder.GetToeplitzKernel( data.Size(), toeplitz_kernel, RadialGridder::KERN_TYPE_KAISER_BESSEL, 0 ) )
+		{
+			GIRLogger::LogError( "Toeplitz gridding failed, aborting!\n" );
+			exit( EXIT_FAILURE );
+		}
+		FilterTool::FFTShift( adjoint_data );
+		FilterTool::FFT2D( adjoint_data, true );
+	}
+
 	// regrid
 	{
 		RadialGridder gridder;
@@ -46,14 +149,38 @@ bool Reconstruct( MRIData& data, float alpha, float beta, float step_size, int i
 	// generate coil map
 	MRIData coil_map;
 	GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> generating coil map...\n" );
-	MRIDataTool::GetCoilMap( data, coil_map );
+	if( axis == AXIS_CHANNEL )
+	{
+		MRIDataTool::GetCoilMap( data, coil_map, false );
+		NormalizeCoilMap( coil_map, MPI_COMM_WORLD );
+	}
+	else
+		MRIDataTool::GetCoilMap( data, coil_map );
+
+	// all parts of a distributed reconstruction use the coil map of the start of the series and all partitions the one
+	// of the first, like a single task would
+	if( ( distributed || axis == AXIS_PARTITION ) && MPI_Bcast( coil_map.GetDataStart(), coil_map.NumElements(), MPI_FLOAT, 0, MPI_COMM_WORLD ) != MPI_SUCCESS )
+	{
+		GIRLogger::LogError( "Coil map broadcast failed, aborting!\n" );
+		MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+	}
 
 	// generate original estimate
 	GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> generating original estimate...\n" );
 	MRIData estimate;
 	MRIDataTool::TemporallyInterpolateKSpace( data, estimate );
 	FilterTool::FFT2D( estimate, true );
-	estimate.MakeAbs();
+	if( axis == AXIS_CHANNEL )
+		CombineChannels( estimate, coil_map, MPI_COMM_WORLD );
+	else
+		estimate.MakeAbs();
+
+	// no lambda map for this data
+	MRIDimensions lambda_dims( estimate.Size().Column, estimate.Size().Line, 1, 1, 1, 1, 1, 1, 1, 1, 1 );
+	MRIData lambda_map( lambda_dims, false );
+	lambda_map.SetAll( 1 );
+
+	MRIData& meas_data = ( use_toeplitz )? adjoint_data: data;
 
 	// iterate
 	if( use_gpu )
@@ -66,7 +193,14 @@ bool Reconstruct( MRIData& data, float alpha, float beta, float step_size, int i
 		GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> reconstructing on GPU...\n" );
 		TCRIteratorCUDA iterator( gpu_thread_load, TCRIterator::TEMP_DIM_REP );
 		iterator.cuda_device = rank % 2;
-		iterator.Load( alpha, beta, step_size, data, estimate, coil_map );
+		iterator.Load( alpha, beta, beta_squared, step_size, meas_data, estimate, coil_map, lambda_map );
+		if( use_toeplitz && !iterator.LoadToeplitz( toeplitz_kernel ) )
+			return false;
+		if( checkpoint_interval > 0 )
+		{
+			iterator.SetCheckpoint( checkpoint_path.c_str(), checkpoint_interval );
+			iterator.Resume();
+		}
 		iterator.Iterate( iterations );
 		iterator.Unload( data );
 #else
@@ -74,108 +208,341 @@ bool Reconstruct( MRIData& data, float alpha, float beta, float step_size, int i
 		return false;
 #endif
 	}
+	else if( distributed )
+	{
+		GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> reconstructing on CPU(s) with the other ranks...\n" );
+		TCRIteratorMPI iterator( threads, TCRIterator::TEMP_DIM_REP, MPI_COMM_WORLD );
+		iterator.Load( alpha, beta, beta_squared, step_size, meas_data, estimate, coil_map, lambda_map );
+		if( use_toeplitz && !iterator.LoadToeplitz( toeplitz_kernel ) )
+			return false;
+		if( checkpoint_interval > 0 )
+		{
+			iterator.SetCheckpoint( checkpoint_path.c_str(), checkpoint_interval );
+			iterator.Resume();
+		}
+		iterator.Iterate( iterations );
+		iterator.Unload( data );
+	}
+	else if( axis == AXIS_CHANNEL )
+	{
+		GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> reconstructing on CPU(s) with the other ranks' channels...\n" );
+		TCRIteratorChannelMPI iterator( threads, TCRIterator::TEMP_DIM_REP, MPI_COMM_WORLD );
+		iterator.Load( alpha, beta, beta_squared, step_size, meas_data, estimate, coil_map, lambda_map );
+		if( use_toeplitz && !iterator.LoadToeplitz( toeplitz_kernel ) )
+			return false;
+		if( checkpoint_interval > 0 )
+		{
+			iterator.SetCheckpoint( checkpoint_path.c_str(), checkpoint_interval );
+			iterator.Resume();
+		}
+		iterator.Iterate( iterations );
+		iterator.Unload( estimate );
+		data = estimate;
+	}
 	else
 	{
 		GIRLogger::LogInfo( "Plugin_TCR::Reconstruct -> reconstructing on CPU(s)...\n" );
 		TCRIteratorCPU iterator( threads, TCRIterator::TEMP_DIM_REP );
-		iterator.Load( alpha, beta, step_size, data, estimate, coil_map );
+		iterator.Load( alpha, beta, beta_squared, step_size, meas_data, estimate, coil_map, lambda_map );
+		if( use_toeplitz && !iterator.LoadToeplitz( toeplitz_kernel ) )
+			return false;
+		if( checkpoint_interval > 0 )
+		{
+			iterator.SetCheckpoint( checkpoint_path.c_str(), checkpoint_interval );
+			iterator.Resume();
+		}
 		iterator.Iterate( iterations );
 		iterator.Unload( data );
 	}
 
+	if( checkpoint_interval > 0 )
+		remove( checkpoint_path.c_str() );
+
 	// shift to center
 	FilterTool::FFTShift( data, true );
 	return true;
 }
 
 
-void ExecuteMaster( int tasks, const char* input_file, float alpha, float beta, float step_size, int iterations, bool use_gpu )
+// the number of chunks dynamic mode cuts repetitions into, workers reading their chunks themselves need it as well
+int NumChunks( int repetitions, int workers )
+{
+	int chunks = std::min( TCR_CHUNKS_PER_WORKER * workers, repetitions / ( TCR_MIN_CHUNK_OVERLAPS * TCR_REPETITION_OVERLAP ) );
+	return std::max( chunks, 1 );
+}
+
+// sends chunk of chunks straight out of data to worker, or only its index if the worker reads it from the repetition
+// file itself (data is 0), or tells it to stop if chunk is -1
+void SendChunk( MRIData* data, int chunk, int chunks, int worker )
+{
+	if( MPI_Send( &chunk, 1, MPI_INT, worker, TCR_CHUNK_TAG, MPI_COMM_WORLD ) != MPI_SUCCESS )
+	{
+		GIRLogger::LogError( "Sending chunk index to %d failed!\n", worker );
+		MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+	}
+	if( chunk < 0 || data == 0 )
+		return;
+
+	int split_start;
+	int split_end;
+	MPIPartitioner::RepetitionRange( data->Size().Repetition, chunk, chunks, TCR_REPETITION_OVERLAP, split_start, split_end );
+	GIRLogger::LogInfo( "Sending chunk %d (repetitions %d to %d) to %d...\n", chunk, split_start, split_end, worker );
+	MPISend send;
+	if( !MPITools::ISendRange( *data, AXIS_REPETITION, split_start, split_end - split_start, split_start, worker, MPI_COMM_WORLD, send ) || !MPITools::WaitSend( send ) )
+	{
+		GIRLogger::LogError( "Sending chunk %d to %d failed!\n", chunk, worker );
+		MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+	}
+}
+
+// hands out overlapping chunks of data of size to the workers as they become free and merges their results into
+// result_data, without data the workers read the chunks from the repetition file
+void DispatchChunks( MRIData* data, const MRIDimensions& size, int tasks, MRIData& result_data )
+{
+	int workers = tasks - 1;
+	int chunks = NumChunks( size.Repetition, workers );
+	GIRLogger::LogInfo( "Dispatching %d chunks to %d workers...\n", chunks, workers );
+
+	int next_chunk = 0;
+	int busy_workers = 0;
+	for( int worker = 1; worker <= workers; worker++ )
+	{
+		if( next_chunk < chunks )
+		{
+			SendChunk( data, next_chunk++, chunks, worker );
+			busy_workers++;
+		}
+		else
+			SendChunk( data, -1, chunks, worker );
+	}
+
+	// results come back in any order, each tagged with its chunk
+	bool have_result = false;
+	while( busy_workers > 0 )
+	{
+		MRIData chunk_data;
+		int chunk;
+		int worker;
+		if( !MPITools::ReceiveAnyData( chunk_data, chunk, worker, MPI_COMM_WORLD ) )
+		{
+			GIRLogger::LogError( "ReceiveAnyData failed!\n" );
+			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+		}
+		busy_workers--;
+		GIRLogger::LogInfo( "Received chunk %d from %d...\n", chunk, worker );
+
+		// the worker is free again
+		if( next_chunk < chunks )
+		{
+			SendChunk( data, next_chunk++, chunks, worker );
+			busy_workers++;
+		}
+		else
+			SendChunk( data, -1, chunks, worker );
+
+		// resize due to gridding
+		if( !have_result )
+		{
+			MRIDimensions new_dims = size;
+			new_dims.Line = chunk_data.Size().Line;
+			new_dims.Column = chunk_data.Size().Column;
+			result_data = MRIData( new_dims, true );
+			result_data.SetAll( 0 );
+			have_result = true;
+		}
+
+		// merge
+		if( !MPIPartitioner::MergeRepetitions( result_data, chunk_data, chunk, chunks, TCR_REPETITION_OVERLAP ) )
+		{
+			GIRLogger::LogError( "MergeRepetitions failed for chunk: %d!\n", chunk );
+			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+		}
+	}
+}
+
+// the part of the data task reconstructs, only repetitions overlap to give every part frames around its body
+void PartRange( const MRIDimensions& size, PartitionAxis axis, int task, int tasks, int overlap, int& start, int& end )
+{
+	MPIPartitioner::RepetitionRange( MPIPartitioner::AxisSize( size, axis ), task, tasks, ( axis == AXIS_REPETITION )? overlap: 0, start, end );
+}
+
+// merges the body of task's part into full_data
+bool MergePart( MRIData& full_data, MRIData& part_data, PartitionAxis axis, int task, int tasks, int overlap )
+{
+	if( axis == AXIS_REPETITION )
+		return MPIPartitioner::MergeRepetitions( full_data, part_data, task, tasks, overlap );
+	int start;
+	int end;
+	PartRange( full_data.Size(), axis, task, tasks, 0, start, end );
+	return MPIPartitioner::MergeAxis( full_data, part_data, axis, start, 0, end - start );
+}
+
+// waits for the sends to tasks 1 and up
+void* WaitSends( void* sends_ptr )
+{
+	std::vector<MPISend>& sends = *(std::vector<MPISend>*)sends_ptr;
+	for( int i = 1; i < (int)sends.size(); i++ )
+	{
+		if( !MPITools::WaitSend( sends[i] ) )
+		{
+			GIRLogger::LogError( "Sending data to %d failed!\n", i );
+			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+		}
+		GIRLogger::LogInfo( "Finished sending data to %d.\n", i );
+	}
+	return 0;
+}
+
+void ExecuteMaster( int tasks, const char* input_file, RepetitionFile* rep_file, float alpha, float beta, float step_size, int iterations, bool use_gpu, bool use_toeplitz, int checkpoint_interval, PartitionMode mode, bool threaded_sends )
 {
-	printf( "parameters:\n\talpha %f, beta %f, step_size %f, iterations %d, use_gpu %d\n", alpha, beta, step_size, iterations, use_gpu );
+	printf( "parameters:\n\talpha %f, beta %f, step_size %f, iterations %d, use_gpu %d, use_toeplitz %d, checkpoint_interval %d, mode %d\n", alpha, beta, step_size, iterations, use_gpu, use_toeplitz, checkpoint_interval, mode );
 		
 	// open file communicator
-	printf( "opening %s...\n", input_file );
 	FileCommunicator communicator;
-	if( !communicator.OpenInput( input_file ) || !communicator.OpenOutput( "tcr_data.out" ) )
+	if( !communicator.OpenOutput( "tcr_data.out" ) )
 	{
 		GIRLogger::LogError( "Unable to open IO files!\n" );
-		exit( EXIT_FAILURE );
+		MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
 	}
 
-	// get request, we don't use right now but we need to get it out of the way
-	GIRLogger::LogInfo( "Loading data...\n" );
-	MRIReconRequest request;
-	communicator.ReceiveReconRequest( request );
-
-	// get data
+	// every task reads its own repetitions from a repetition file, anything else the master loads and sends out
 	MRIData data;
-	communicator.ReceiveData( data );
+	MRIDimensions size;
+	if( rep_file != 0 )
+	{
+		GIRLogger::LogInfo( "Tasks reading their repetitions from %s (%s)...\n", input_file, rep_file->size.ToString().c_str() );
+		size = rep_file->size;
+	}
+	else
+	{
+		printf( "opening %s...\n", input_file );
+		if( !communicator.OpenInput( input_file ) )
+		{
+			GIRLogger::LogError( "Unable to open IO files!\n" );
+			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+		}
+
+		// get request, we don't use right now but we need to get it out of the way
+		GIRLogger::LogInfo( "Loading data...\n" );
+		MRIReconRequest request;
+		communicator.ReceiveReconRequest( request );
+
+		// get data
+		communicator.ReceiveData( data );
+		size = data.Size();
+	}
+
+	// the master only coordinates dynamic chunks, alone it falls back to reconstructing everything itself
+	if( mode == MODE_DYNAMIC && tasks > 1 )
+	{
+		MRIData result_data;
+		DispatchChunks( ( rep_file != 0 )? 0: &data, size, tasks, result_data );
+		GIRLogger::LogInfo( "Writing output...\n" );
+		communicator.SendData( result_data );
+		GIRLogger::LogInfo( "Done.\n" );
+		return;
+	}
+
+	// a distributed reconstruction needs no overlap but at least one repetition per task, otherwise the data is split
+	// along whichever axis suits its shape, the channel iterator only runs on the CPU
+	bool distributed = ( mode == MODE_DISTRIBUTED );
+	int overlap = ( distributed )? 0: TCR_REPETITION_OVERLAP;
+	if( distributed && size.Repetition < tasks )
+	{
+		GIRLogger::LogError( "%d repetitions can't be distributed over %d tasks!\n", size.Repetition, tasks );
+		MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+	}
+	PartitionAxis axis = ( distributed )? AXIS_REPETITION: MPIPartitioner::ChooseAxis( size, tasks, overlap, !use_gpu );
+	int axis_index = axis;
+	MPI_Bcast( &axis_index, 1, MPI_INT, 0, MPI_COMM_WORLD );
+	GIRLogger::LogInfo( "Splitting %d %ss over %d tasks...\n", MPIPartitioner::AxisSize( size, axis ), MPIPartitioner::AxisName( axis ), tasks );
+
+	// start sending every other task its part straight out of the full data
+	std::vector<MPISend> sends( tasks );
+	bool sending = ( rep_file == 0 );
+	for( int i = 1; sending && i < tasks; i++ )
+	{
+		int split_start;
+		int split_end;
+		PartRange( size, axis, i, tasks, overlap, split_start, split_end );
+		GIRLogger::LogInfo( "Sending data to %d...\n", i );
+		if( !MPITools::ISendRange( data, axis, split_start, split_end - split_start, split_start, i, MPI_COMM_WORLD, sends[i] ) )
+		{
+			GIRLogger::LogError( "ISendRange to %d failed!\n", i );
+			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+		}
+	}
 
-	// send data
-	int overlap = 3;
+	// the sends only move on while this task is inside MPI, so a thread waits for them while the master reconstructs,
+	// without thread support in MPI they have to finish first
+	pthread_t send_thread;
+	if( sending && threaded_sends )
+		pthread_create( &send_thread, 0, WaitSends, &sends );
+	else if( sending )
+		WaitSends( &sends );
 
-	for( int i = tasks-1; i >=0; i-- )
+	// data for master
 	{
-		// split off data
 		MRIData split_data;
 		int split_start;
 		int split_end;
-		if( !MPIPartitioner::SplitRepetitions( data, split_data, i, tasks, overlap, split_start, split_end ) )
+		PartRange( size, axis, 0, tasks, overlap, split_start, split_end );
+		bool split = false;
+		if( rep_file != 0 )
+			split = MPITools::ReadRange( *rep_file, axis, split_start, split_end - split_start, split_data, MPI_COMM_WORLD );
+		else
+			split = MPIPartitioner::SplitAxis( data, split_data, axis, split_start, split_end - split_start );
+		if( !split )
 		{
-			GIRLogger::LogError( "SplitRepetitions failed for task: %d!\n", i );
+			GIRLogger::LogError( "SplitAxis failed for task: 0!\n" );
 			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
 		}
 
-		// data for master
-		if( i == 0 )
+		// reconstruct, only repetitions move the golden ratio views
+		Reconstruct( split_data, alpha, beta, step_size, iterations, use_gpu==1, use_toeplitz, ( axis == AXIS_REPETITION )? split_start: 0, checkpoint_interval, CheckpointPath( axis, split_start ), axis, distributed );
+
+		// the full data is still being sent from until all sends are done
+		if( sending && threaded_sends )
+			pthread_join( send_thread, 0 );
+
+		// the combined images of a channel split are the whole result, the other tasks hold the same
+		if( axis == AXIS_CHANNEL )
+			data = split_data;
+		else
 		{
-			// reconstruct
-			Reconstruct( split_data, alpha, beta, step_size, iterations, use_gpu==1, split_start );
 			// resize due to gridding
-			MRIDimensions new_dims = data.Size();
+			MRIDimensions new_dims = size;
 			new_dims.Line = split_data.Size().Line;
 			new_dims.Column = split_data.Size().Column;
 			data = MRIData( new_dims, true );
 			data.SetAll( 0 );
 			// merge
-			if( !MPIPartitioner::MergeRepetitions( data, split_data, i, tasks, overlap ) )
-			{
-				GIRLogger::LogError( "MergeRepetitions failed for task: %d!\n", i );
-				MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
-			}
-
-		}
-		// data for another task
-		else
-		{
-			GIRLogger::LogInfo( "Sending data to %d...\n", i );
-			if( !MPITools::SendData( split_data, split_start, i, MPI_COMM_WORLD ) )
+			if( !MergePart( data, split_data, axis, 0, tasks, overlap ) )
 			{
-				GIRLogger::LogDebug( "SendData to %d failed!\n", i );
+				GIRLogger::LogError( "MergePart failed for task: 0!\n" );
 				MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
 			}
-			GIRLogger::LogInfo( "Finished sending data to %d.\n", i );
 		}
 	}
 
-	// get data from other tasks
-	for( int i = 1; i < tasks; i++ )
+	// get data from other tasks in the order they finish
+	for( int i = 1; axis != AXIS_CHANNEL && i < tasks; i++ )
 	{
-		GIRLogger::LogInfo( "Receiving data from %d...\n", i );
-
 		// receive
 		MRIData split_data;
 		int rep_offset; // meaningless in this context...
-		if( !MPITools::ReceiveData( split_data, rep_offset, i, MPI_COMM_WORLD ) )
+		int task;
+		if( !MPITools::ReceiveAnyData( split_data, rep_offset, task, MPI_COMM_WORLD ) )
 		{
-			GIRLogger::LogError( "ReceiveData from task %d failed!\n", i );
+			GIRLogger::LogError( "ReceiveAnyData failed!\n" );
 			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
 		}
+		GIRLogger::LogInfo( "Received data from %d...\n", task );
 
 		// merge
-		if( !MPIPartitioner::MergeRepetitions( data, split_data, i, tasks, overlap ) )
+		if( !MergePart( data, split_data, axis, task, tasks, overlap ) )
 		{
-			GIRLogger::LogError( "MergeRepetitions failed for task: %d!\n", i );
+			GIRLogger::LogError( "MergePart failed for task: %d!\n", task );
 			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
 		}
 	}
@@ -186,30 +553,98 @@ void ExecuteMaster( int tasks, const char* input_file, float alpha, float beta,
 	GIRLogger::LogInfo( "Done.\n" );
 }
 
-void ExecuteSlave( float alpha, float beta, float step_size, int iterations, bool use_gpu )
+void ExecuteSlave( int tasks, RepetitionFile* rep_file, float alpha, float beta, float step_size, int iterations, bool use_gpu, bool use_toeplitz, int checkpoint_interval, PartitionMode mode )
 {
 	int rank;
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 
-	// recieve data
-	MRIData split_data;
-	int rep_offset;
-	MPITools::ReceiveData( split_data, rep_offset, 0, MPI_COMM_WORLD );
+	// the master tells the others which axis it splits the data along, dynamic chunks are always repetitions
+	int axis_index = AXIS_REPETITION;
+	if( mode != MODE_DYNAMIC )
+		MPI_Bcast( &axis_index, 1, MPI_INT, 0, MPI_COMM_WORLD );
+	PartitionAxis axis = (PartitionAxis)axis_index;
+
+	// dynamic workers take chunks until the master runs out of them
+	int chunk = 0;
+	while( chunk >= 0 )
+	{
+		if( mode == MODE_DYNAMIC && MPI_Recv( &chunk, 1, MPI_INT, 0, TCR_CHUNK_TAG, MPI_COMM_WORLD, MPI_STATUS_IGNORE ) != MPI_SUCCESS )
+		{
+			GIRLogger::LogError( "\t(%d) receiving chunk index failed!\n", rank );
+			MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+		}
+		if( chunk < 0 )
+			break;
+
+		// recieve data, or read it alongside the other tasks
+		MRIData split_data;
+		int split_start;
+		if( rep_file != 0 )
+		{
+			int split_end;
+			bool read = false;
+			if( mode == MODE_DYNAMIC )
+			{
+				MPIPartitioner::RepetitionRange( rep_file->size.Repetition, chunk, NumChunks( rep_file->size.Repetition, tasks - 1 ), TCR_REPETITION_OVERLAP, split_start, split_end );
+				read = MPITools::ReadRange( *rep_file, axis, split_start, split_end - split_start, split_data, MPI_COMM_SELF );
+			}
+			else
+			{
+				PartRange( rep_file->size, axis, rank, tasks, ( mode == MODE_DISTRIBUTED )? 0: TCR_REPETITION_OVERLAP, split_start, split_end );
+				read = MPITools::ReadRange( *rep_file, axis, split_start, split_end - split_start, split_data, MPI_COMM_WORLD );
+			}
+			if( !read )
+				MPI_Abort( MPI_COMM_WORLD, EXIT_FAILURE );
+		}
+		else
+			MPITools::ReceiveData( split_data, split_start, 0, MPI_COMM_WORLD );
+
+		// reconstruct 
+		GIRLogger::LogInfo( "\t(%d) reconstructing...\n", rank );
+		Reconstruct( split_data, alpha, beta, step_size, iterations, use_gpu==1, use_toeplitz, ( axis == AXIS_REPETITION )? split_start: 0, checkpoint_interval, CheckpointPath( axis, split_start ), axis, mode == MODE_DISTRIBUTED );
+		GIRLogger::LogInfo( "\t(%d) done reconstructing...\n", rank );
+
+		// send back, a dynamic chunk carries its index, the master already has the combined images of a channel split
+		if( axis != AXIS_CHANNEL )
+			MPITools::SendData( split_data, ( mode == MODE_DYNAMIC )? chunk: -1, 0, MPI_COMM_WORLD );
+		if( mode != MODE_DYNAMIC )
+			chunk = -1;
+	}
+}
 
-	// reconstruct 
-	GIRLogger::LogInfo( "\t(%d) reconstructing...\n", rank );
-	Reconstruct( split_data, alpha, beta, step_size, iterations, use_gpu==1, rep_offset );
-	GIRLogger::LogInfo( "\t(%d) done reconstructing...\n", rank );
+// writes the data of a FileCommunicator input to INPUT_FILE.reps for later runs to read in parallel
+bool ConvertInput( const char* input_file )
+{
+	FileCommunicator communicator;
+	if( !communicator.OpenInput( input_file ) )
+	{
+		GIRLogger::LogError( "Unable to open %s!\n", input_file );
+		return false;
+	}
+	MRIReconRequest request;
+	MRIData data;
+	communicator.ReceiveReconRequest( request );
+	communicator.ReceiveData( data );
 
-	// send back
-	MPITools::SendData( split_data, -1, 0, MPI_COMM_WORLD );
+	std::string rep_path = std::string( input_file ) + TCR_REPETITION_FILE_SUFFIX;
+	if( !MPITools::WriteRepetitionFile( data, rep_path.c_str() ) )
+		return false;
+	GIRLogger::LogInfo( "Wrote %s (%s), pass it as INPUT_FILE to have the tasks load in parallel.\n", rep_path.c_str(), data.Size().ToString().c_str() );
+	return true;
 }
 
 int main( int argc, char** argv )
 {
-	if( argc != 7 )
+	// converting the input is a separate step, a run never writes a second copy of its input by itself
+	if( argc == 3 && std::string( argv[1] ) == "-convert" )
+		exit( ( ConvertInput( argv[2] ) )? EXIT_SUCCESS: EXIT_FAILURE );
+
+	if( argc < 7 || argc > 10 )
 	{
-		fprintf( stderr, "USAGE: mpi-tcr INPUT_FILE ALPHA BETA STEP_SIZE ITERATIONS USE_GPU\n" );
+		fprintf( stderr, "USAGE: mpi-tcr INPUT_FILE ALPHA BETA STEP_SIZE ITERATIONS USE_GPU [USE_TOEPLITZ [CHECKPOINT_INTERVAL [MODE]]]\n" );
+		fprintf( stderr, "       mpi-tcr -convert INPUT_FILE\n" );
+		fprintf( stderr, "\tMODE: 0 static blocks along the axis best suited to the data (coil combined images if that is channels), 1 distributed with halo exchange (CPU only), 2 dynamic chunks\n" );
+		fprintf( stderr, "\tINPUT_FILE: FileCommunicator data, loaded by task 0, or a repetition file (INPUT_FILE" TCR_REPETITION_FILE_SUFFIX " written by -convert), read by all tasks in parallel\n" );
 		exit( EXIT_FAILURE );
 	}
 
@@ -220,27 +655,60 @@ int main( int argc, char** argv )
 	double step_size;
 	int iterations;
 	int use_gpu;
+	int use_toeplitz = 0;
+	int checkpoint_interval = 0;
+	int mode = MODE_STATIC;
 	std::stringstream str;
 	str << argv[2]  << " " << argv[3] << " " << argv[4] << " " << argv[5] << " " << argv[6];
 	str >> alpha >> beta >> step_size >> iterations >> use_gpu;
+	if( argc >= 8 )
+	{
+		std::stringstream toeplitz_str( argv[7] );
+		toeplitz_str >> use_toeplitz;
+	}
+	if( argc >= 9 )
+	{
+		std::stringstream checkpoint_str( argv[8] );
+		checkpoint_str >> checkpoint_interval;
+	}
+	if( argc == 10 )
+	{
+		std::stringstream mode_str( argv[9] );
+		mode_str >> mode;
+	}
+	if( mode < MODE_STATIC || mode > MODE_DYNAMIC )
+	{
+		fprintf( stderr, "invalid MODE: %d\n", mode );
+		exit( EXIT_FAILURE );
+	}
+	if( mode == MODE_DISTRIBUTED && use_gpu == 1 )
+	{
+		fprintf( stderr, "MODE 1 (distributed) is only supported on the CPU\n" );
+		exit( EXIT_FAILURE );
+	}
 	
 	// initialize MPI
 	int rank;
 	int tasks;
-	MPI_Init( &argc, &argv );
+	int thread_support;
+	MPI_Init_thread( &argc, &argv, MPI_THREAD_MULTIPLE, &thread_support );
 	MPI_Comm_rank(MPI_COMM_WORLD, &rank);
 	MPI_Comm_size(MPI_COMM_WORLD, &tasks);
 
+	// a repetition file lets every task read its own repetitions
+	RepetitionFile rep_file;
+	RepetitionFile* parallel_input = ( MPITools::OpenRepetitionFile( input_file, rep_file, MPI_COMM_WORLD ) )? &rep_file: 0;
+
 	// execute
 	if( rank == 0 )
 	{
 		GIRLogger::LogInfo( "task 0 starting, %d total tasks...\n", tasks );
-		ExecuteMaster( tasks, argv[1], alpha, beta, step_size, iterations, use_gpu );
+		ExecuteMaster( tasks, input_file, parallel_input, alpha, beta, step_size, iterations, use_gpu, use_toeplitz==1, checkpoint_interval, (PartitionMode)mode, thread_support >= MPI_THREAD_MULTIPLE );
 	}
 	else
 	{
 		GIRLogger::LogInfo( "task %d starting...\n", rank);
-		ExecuteSlave( alpha, beta, step_size, iterations, use_gpu );
+		ExecuteSlave( tasks, parallel_input, alpha, beta, step_size, iterations, use_gpu, use_toeplitz==1, checkpoint_interval, (PartitionMode)mode );
 	}
 
 	// finalize MPI